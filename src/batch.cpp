@@ -0,0 +1,79 @@
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <memory_resource>
+
+#include "batch.h"
+#include "thread_pool.h"
+
+namespace fs = std::filesystem;
+
+// Lets the pools keep the growing buffers of the arenas of large scripts too.
+const std::pmr::pool_options BATCH_POOL_OPTIONS = { .max_blocks_per_chunk = 0, .largest_required_pool_block = 4 * 1024 * 1024 };
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Longest files first, so the last files handed out are the short ones and
+// threads finish close together.
+std::vector<size_t> schedule(const std::vector<std::string>& paths, std::vector<FileReport>& files) {
+    for (size_t idx = 0; idx < paths.size(); idx++) {
+        std::error_code err;
+        const uintmax_t size = fs::file_size(paths[idx], err);
+        files[idx] = { .path = paths[idx], .bytes = err ? 0 : uint64_t(size) };
+    }
+    std::vector<size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return files[a].bytes > files[b].bytes;
+    });
+    return order;
+}
+
+BatchReport compile_batch(const std::vector<std::string>& paths, StateMachine& machine, const BatchOptions& options) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BatchReport report = { .files = std::vector<FileReport>(paths.size()) };
+    if (options.keep_taxonomies) {
+        report.taxonomies.resize(paths.size());
+    }
+    const std::vector<size_t> order = schedule(paths, report.files);
+
+    const size_t requested = options.threads == 0 ? hardware_threads() : options.threads;
+    const size_t threads = machine.concurrent_lookups()
+        ? std::max<size_t>(1, std::min(requested, paths.size()))
+        : 1;
+    // Each thread reuses the memory of the scans before it. Kept taxonomies
+    // outlive the batch and allocate from the default resource instead.
+    std::deque<std::pmr::unsynchronized_pool_resource> pools;
+    for (size_t slot = 0; slot < threads; slot++) {
+        pools.emplace_back(BATCH_POOL_OPTIONS);
+    }
+    ThreadPool pool = ThreadPool(threads);
+    pool.run(order.size(), [&](size_t idx, size_t slot) {
+        FileReport& file = report.files[order[idx]];
+        const ScanOptions scan_options = {
+            .threads = 1,
+            .scratch_upstream = &pools[slot],
+            .arena_upstream = options.keep_taxonomies ? std::pmr::get_default_resource() : &pools[slot]
+        };
+        const std::chrono::steady_clock::time_point scan_start = std::chrono::steady_clock::now();
+        FileTaxonomy taxonomy = scan_path(file.path, machine, scan_options);
+        file.scan_ns = elapsed_ns(scan_start);
+        file.errors = taxonomy.errors;
+        if (options.keep_taxonomies) {
+            report.taxonomies[order[idx]] = std::move(taxonomy);
+        }
+    });
+
+    for (const FileReport& file : report.files) {
+        report.failed_files += file.errors.empty() ? 0 : 1;
+        report.bytes += file.bytes;
+        report.scan_ns += file.scan_ns;
+    }
+    report.wall_ns = elapsed_ns(start);
+    return report;
+}
@@ -0,0 +1,44 @@
+#ifndef LK_BATCH
+#define LK_BATCH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "errors.h"
+#include "taxscan.h"
+#include "state_machine.h"
+
+struct BatchOptions {
+    // Threads to compile on, 0 for every hardware thread.
+    size_t threads = 0;
+    // Keeps the taxonomy of every file in the report, not only its errors.
+    bool keep_taxonomies = false;
+};
+
+struct FileReport {
+    std::string path;
+    std::vector<CompilationError> errors;
+    uint64_t bytes;
+    uint64_t scan_ns;
+};
+
+struct BatchReport {
+    // In the order the paths were given.
+    std::vector<FileReport> files;
+    // Empty unless BatchOptions::keep_taxonomies, otherwise in file order.
+    std::vector<FileTaxonomy> taxonomies;
+    size_t failed_files;
+    uint64_t bytes;
+    // Sum of the scan times of all files.
+    uint64_t scan_ns;
+    uint64_t wall_ns;
+};
+
+// Compiles every script in paths against one shared machine. Files are
+// handed out largest first to whichever thread is free, and each thread
+// scans from memory pools it keeps for the whole batch. Machines that do
+// not allow concurrent lookups compile the batch on the calling thread.
+BatchReport compile_batch(const std::vector<std::string>& paths, StateMachine& machine, const BatchOptions& options = {});
+
+#endif
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+
+#include "batch.h"
+
+namespace fs = std::filesystem;
+
+class BatchStateMachine: public StateMachine {
+    public:
+    bool concurrent = true;
+    std::mutex threads_mutex;
+    std::set<std::thread::id> threads;
+
+    std::optional<InstructionID> find_instr(const std::string& name) {
+        {
+            std::lock_guard<std::mutex> lock(this->threads_mutex);
+            this->threads.insert(std::this_thread::get_id());
+        }
+        if (name == "if") {
+            return 1;
+        }
+        if (name == "print") {
+            return 2;
+        }
+        return std::nullopt;
+    }
+
+    TaxStrat tax_strat(InstructionID instr) {
+        if (instr == 1) {
+            return branch_strat({"else"});
+        }
+        return command_strat();
+    }
+
+    bool concurrent_lookups() {
+        return this->concurrent;
+    }
+};
+
+// Writes count scripts, every third one with an unknown instruction.
+std::vector<std::string> batch_scripts(size_t count) {
+    const fs::path dir = fs::temp_directory_path() / "lorikeet_test" / "batch";
+    fs::create_directories(dir);
+    std::vector<std::string> paths;
+    for (size_t idx = 0; idx < count; idx++) {
+        const std::string path = (dir / ("script" + std::to_string(idx) + ".lk")).string();
+        std::ofstream out(path);
+        for (size_t line = 0; line < idx * 10; line++) {
+            out << "print " << line << "\nif true\n\tprint 'then'\nelse\n\tprint 'else'\n";
+        }
+        if (idx % 3 == 0) {
+            out << "missing\n";
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+TEST(Batch, ReportsErrorsPerFileInOrder) {
+    BatchStateMachine machine;
+    const std::vector<std::string> paths = batch_scripts(12);
+
+    const BatchReport report = compile_batch(paths, machine, { .threads = 4 });
+
+    ASSERT_EQ(report.files.size(), paths.size());
+    for (size_t idx = 0; idx < paths.size(); idx++) {
+        EXPECT_EQ(report.files[idx].path, paths[idx]);
+        EXPECT_EQ(report.files[idx].errors, scan_path(paths[idx], machine).errors);
+        EXPECT_EQ(report.files[idx].bytes, fs::file_size(paths[idx]));
+    }
+    EXPECT_EQ(report.failed_files, 4);
+    EXPECT_TRUE(report.taxonomies.empty());
+}
+
+TEST(Batch, KeepsTaxonomies) {
+    BatchStateMachine machine;
+    const std::vector<std::string> paths = batch_scripts(6);
+
+    const BatchReport report = compile_batch(paths, machine, { .threads = 3, .keep_taxonomies = true });
+
+    ASSERT_EQ(report.taxonomies.size(), paths.size());
+    for (size_t idx = 0; idx < paths.size(); idx++) {
+        EXPECT_EQ(report.taxonomies[idx], scan_path(paths[idx], machine));
+    }
+}
+
+TEST(Batch, ReportsUnreadableFiles) {
+    BatchStateMachine machine;
+
+    const BatchReport report = compile_batch({ "/does/not/exist.lk" }, machine);
+
+    ASSERT_EQ(report.files.size(), 1);
+    EXPECT_EQ(report.files[0].errors, std::vector<CompilationError>({ unreadable_file() }));
+    EXPECT_EQ(report.failed_files, 1);
+}
+
+TEST(Batch, MachineWithoutConcurrentLookupsStaysOnCallingThread) {
+    BatchStateMachine machine;
+    machine.concurrent = false;
+
+    compile_batch(batch_scripts(8), machine, { .threads = 4 });
+
+    EXPECT_EQ(machine.threads, std::set<std::thread::id>({ std::this_thread::get_id() }));
+}
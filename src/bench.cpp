@@ -0,0 +1,177 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <sys/resource.h>
+
+#include "bench.h"
+
+std::atomic<size_t> allocation_count = 0;
+std::atomic<size_t> allocation_bytes = 0;
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept {
+    std::free(memory);
+}
+
+// std::pmr::new_delete_resource allocates through the aligned overloads.
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    const size_t align = std::max(size_t(alignment), sizeof(void*));
+    void* memory = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t size, std::align_val_t alignment) noexcept {
+    std::free(memory);
+}
+
+size_t allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+size_t allocated_bytes() {
+    return allocation_bytes.load(std::memory_order_relaxed);
+}
+
+double peak_rss_mb() {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+struct Bench {
+    std::string name;
+    BenchFunction function;
+};
+
+const std::chrono::nanoseconds MIN_BENCH_TIME = std::chrono::milliseconds(200);
+
+std::vector<Bench>& benches() {
+    static std::vector<Bench> registered;
+    return registered;
+}
+
+int register_bench(const std::string& name, BenchFunction function) {
+    benches().push_back({ .name = name, .function = function });
+    return benches().size();
+}
+
+std::vector<std::string> generated_script(size_t line_count) {
+    std::vector<std::string> lines;
+    lines.reserve(line_count);
+    for (size_t block = 0; lines.size() < line_count; block++) {
+        const std::string num = std::to_string(block);
+        const std::vector<std::string> statements = {
+            "print 'line " + num + "'",
+            "var count := " + num + " + 1",
+            "if count > 10",
+            "    curl -X POST http://example.com/api/" + num + " --header \"Accept: json\"",
+            "    if count > 20",
+            "        print \"big " + num + "\"",
+            "    print `done`",
+            "else",
+            "    print 'small'",
+            "# comment about block " + num,
+            "exit"
+        };
+        for (const std::string& statement : statements) {
+            if (lines.size() == line_count) {
+                break;
+            }
+            lines.push_back(statement);
+        }
+    }
+    return lines;
+}
+
+size_t script_bytes(const std::vector<std::string>& lines) {
+    size_t bytes = 0;
+    for (const std::string& line : lines) {
+        bytes += line.size() + 1;
+    }
+    return bytes;
+}
+
+void BenchState::start() {
+    this->started = std::chrono::steady_clock::now();
+}
+
+void BenchState::counter(const std::string& name, double value) {
+    for (BenchCounter& counter : this->counters) {
+        if (counter.name == name) {
+            counter.value = value;
+            return;
+        }
+    }
+    this->counters.push_back({ .name = name, .value = value });
+}
+
+std::chrono::nanoseconds run_once(const Bench& bench, BenchState& state) {
+    state.counters.clear();
+    state.bytes = 0;
+    state.items = 0;
+    state.start();
+    bench.function(state);
+    return std::chrono::steady_clock::now() - state.started;
+}
+
+void run(const Bench& bench) {
+    BenchState state = { .iterations = 1, .bytes = 0, .items = 0 };
+    std::chrono::nanoseconds elapsed = run_once(bench, state);
+    while (elapsed < MIN_BENCH_TIME && state.iterations < (size_t(1) << 40)) {
+        state.iterations *= elapsed.count() == 0 ? 100 : std::max<size_t>(2, MIN_BENCH_TIME / elapsed + 1);
+        elapsed = run_once(bench, state);
+    }
+    const double per_iteration = double(elapsed.count()) / state.iterations;
+    std::cout << std::left << std::setw(48) << bench.name;
+    std::cout << std::right << std::setw(14) << std::fixed << std::setprecision(1) << per_iteration << " ns/op";
+    std::cout << std::setw(12) << state.iterations << " iters";
+    if (state.items > 0) {
+        std::cout << "  " << std::setprecision(2) << per_iteration / state.items << " ns/item";
+    }
+    if (state.bytes > 0) {
+        std::cout << "  " << std::setprecision(1) << (state.bytes * 1e3) / per_iteration << " MB/s";
+    }
+    for (const BenchCounter& counter : state.counters) {
+        std::cout << "  " << counter.name << "=" << std::setprecision(2) << counter.value;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const std::string filter = argc > 1 ? argv[1] : "";
+    for (const Bench& bench : benches()) {
+        if (bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        run(bench);
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef LK_BENCH
+#define LK_BENCH
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+struct BenchCounter {
+    std::string name;
+    double value;
+};
+
+struct BenchState {
+    size_t iterations;
+    size_t bytes;
+    size_t items;
+    std::vector<BenchCounter> counters;
+    std::chrono::steady_clock::time_point started;
+
+    void start();
+    void counter(const std::string& name, double value);
+};
+
+typedef std::function<void(BenchState& state)> BenchFunction;
+
+int register_bench(const std::string& name, BenchFunction function);
+
+// A script of line_count lines mixing plain statements, comments and
+// nested if/else blocks, using the instructions print, var, if, curl and exit.
+std::vector<std::string> generated_script(size_t line_count);
+size_t script_bytes(const std::vector<std::string>& lines);
+
+// Number of calls to operator new made by the bench binary so far.
+size_t allocations();
+// Bytes requested from operator new by the bench binary so far.
+size_t allocated_bytes();
+// Peak resident set size of the bench process, run a single bench to
+// attribute it.
+double peak_rss_mb();
+
+template <typename T>
+void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "char_class.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LK_X86_SIMD 1
+#endif
+
+// Matches isalpha/isdigit/isspace in the C locale, bytes outside of ASCII
+// are symbols.
+constexpr CharClass classify(unsigned char c) {
+    if (c == '`') {
+        return CharClass::Backquote;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') {
+        return CharClass::Word;
+    }
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+        return CharClass::Whitespace;
+    }
+    return CharClass::Symbol;
+}
+
+constexpr std::array<CharClass, 256> build_char_classes() {
+    std::array<CharClass, 256> classes = {};
+    for (size_t c = 0; c < classes.size(); c++) {
+        classes[c] = classify(c);
+    }
+    return classes;
+}
+
+const std::array<CharClass, 256> CHAR_CLASSES = build_char_classes();
+
+size_t run_end_scalar(const char* text, size_t from, size_t size, CharClass cls) {
+    while (from < size && char_class(text[from]) == cls) {
+        from++;
+    }
+    return from;
+}
+
+#ifdef LK_X86_SIMD
+
+const size_t SCALAR_PROBE = 16;
+
+// Lanes of v that lie in [lo, hi], using an unsigned min since SSE2 has no
+// unsigned compare.
+__attribute__((always_inline)) inline __m128i in_range_sse2(__m128i v, char lo, char hi) {
+    const __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(hi - lo)), shifted);
+}
+
+__attribute__((always_inline)) inline uint32_t class_mask_sse2(__m128i v, CharClass cls) {
+    __m128i mask;
+    if (cls == CharClass::Word) {
+        mask = _mm_or_si128(
+            _mm_or_si128(in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'), in_range_sse2(v, '0', '9')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+        );
+    } else {
+        mask = _mm_or_si128(in_range_sse2(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    }
+    return uint32_t(_mm_movemask_epi8(mask));
+}
+
+// Always inlined, so when the AVX2 path finishes its tail with it the code
+// is VEX encoded and does not pay for switching between SSE and AVX state.
+__attribute__((always_inline)) inline size_t run_end_16(const char* text, size_t from, size_t size, CharClass cls) {
+    while (from + 16 <= size) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + from));
+        const uint32_t outside = ~class_mask_sse2(v, cls) & 0xFFFF;
+        if (outside != 0) {
+            return from + __builtin_ctz(outside);
+        }
+        from += 16;
+    }
+    while (from < size && char_class(text[from]) == cls) {
+        from++;
+    }
+    return from;
+}
+
+// Most runs in a script are a few bytes long, a short scalar probe settles
+// those before any vector constants are set up.
+__attribute__((always_inline)) inline bool run_ends_early(const char* text, size_t& from, size_t size, CharClass cls) {
+    const size_t probe_end = from + SCALAR_PROBE < size ? from + SCALAR_PROBE : size;
+    while (from < probe_end) {
+        if (char_class(text[from]) != cls) {
+            return true;
+        }
+        from++;
+    }
+    return from == size;
+}
+
+size_t run_end_sse2(const char* text, size_t from, size_t size, CharClass cls) {
+    if (cls != CharClass::Word && cls != CharClass::Whitespace) {
+        return run_end_scalar(text, from, size, cls);
+    }
+    if (run_ends_early(text, from, size, cls)) {
+        return from;
+    }
+    return run_end_16(text, from, size, cls);
+}
+
+__attribute__((target("avx2"), always_inline))
+inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+    const __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(hi - lo)), shifted);
+}
+
+__attribute__((target("avx2"), always_inline))
+inline uint32_t class_mask_avx2(__m256i v, CharClass cls) {
+    __m256i mask;
+    if (cls == CharClass::Word) {
+        mask = _mm256_or_si256(
+            _mm256_or_si256(in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'), in_range_avx2(v, '0', '9')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+        );
+    } else {
+        mask = _mm256_or_si256(in_range_avx2(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    }
+    return uint32_t(_mm256_movemask_epi8(mask));
+}
+
+__attribute__((target("avx2")))
+size_t run_end_avx2(const char* text, size_t from, size_t size, CharClass cls) {
+    if (cls != CharClass::Word && cls != CharClass::Whitespace) {
+        return run_end_scalar(text, from, size, cls);
+    }
+    if (run_ends_early(text, from, size, cls)) {
+        return from;
+    }
+    while (from + 32 <= size) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + from));
+        const uint32_t outside = ~class_mask_avx2(v, cls);
+        if (outside != 0) {
+            return from + __builtin_ctz(outside);
+        }
+        from += 32;
+    }
+    return run_end_16(text, from, size, cls);
+}
+
+#endif
+
+CharClassIsa detected_isa() {
+#ifdef LK_X86_SIMD
+    static const CharClassIsa isa = __builtin_cpu_supports("avx2")
+        ? CharClassIsa::Avx2
+        : CharClassIsa::Sse2;
+    return isa;
+#else
+    return CharClassIsa::Scalar;
+#endif
+}
+
+RunEndFinder run_end_finder(CharClassIsa isa) {
+#ifdef LK_X86_SIMD
+    if (isa == CharClassIsa::Avx2) {
+        return run_end_avx2;
+    }
+    if (isa == CharClassIsa::Sse2) {
+        return run_end_sse2;
+    }
+#endif
+    return run_end_scalar;
+}
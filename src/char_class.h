@@ -0,0 +1,36 @@
+#ifndef LK_CHAR_CLASS
+#define LK_CHAR_CLASS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class CharClass : uint8_t {
+    Word,
+    Whitespace,
+    Symbol,
+    Backquote
+};
+
+extern const std::array<CharClass, 256> CHAR_CLASSES;
+
+inline CharClass char_class(char c) {
+    return CHAR_CLASSES[static_cast<unsigned char>(c)];
+}
+
+enum class CharClassIsa {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// The widest instruction set the running CPU supports.
+CharClassIsa detected_isa();
+
+// Index of the first character at or after from that is not of class cls,
+// or size if the run reaches the end. Only Word and Whitespace form runs.
+typedef size_t (*RunEndFinder)(const char* text, size_t from, size_t size, CharClass cls);
+
+RunEndFinder run_end_finder(CharClassIsa isa);
+
+#endif
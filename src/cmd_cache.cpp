@@ -0,0 +1,140 @@
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <filesystem>
+#include <unistd.h>
+
+#include "cmd_cache.h"
+
+namespace fs = std::filesystem;
+
+const char CMD_CACHE_MAGIC[8] = {'L', 'K', 'C', 'M', 'D', 'S', 0, 0};
+const uint32_t CMD_CACHE_VERSION = 1;
+
+// On disk layout, all integers in host byte order:
+//   CommandCacheHeader
+//   DirStamp[dir_count]
+//   CachedCommand[instr_count]
+//   char path_var[path_length]
+//   char strings[strings_size]
+struct CommandCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dir_count;
+    uint32_t instr_count;
+    uint32_t path_length;
+    uint64_t strings_size;
+};
+
+struct CachedCommand {
+    InstructionID id;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t path_offset;
+    uint32_t path_length;
+};
+
+std::optional<std::vector<CommandInstr>> MappedCommandCache::load(const CommandCacheKey& key) {
+    const MappedFile mapped_file(this->file);
+    const std::string_view mapped = mapped_file.data();
+    if (!mapped_file.owned_by_user() || mapped.size() < sizeof(CommandCacheHeader)) {
+        return std::nullopt;
+    }
+    CommandCacheHeader header;
+    std::memcpy(&header, mapped.data(), sizeof(header));
+    if (std::memcmp(header.magic, CMD_CACHE_MAGIC, sizeof(CMD_CACHE_MAGIC)) != 0
+        || header.version != CMD_CACHE_VERSION
+        || header.dir_count != key.stamps.size()
+        || header.path_length != key.path_var.size()) {
+        return std::nullopt;
+    }
+    const size_t stamps_at = sizeof(CommandCacheHeader);
+    const size_t commands_at = stamps_at + sizeof(DirStamp) * header.dir_count;
+    const size_t path_at = commands_at + sizeof(CachedCommand) * header.instr_count;
+    const size_t strings_at = path_at + header.path_length;
+    if (strings_at + header.strings_size != mapped.size()) {
+        return std::nullopt;
+    }
+    for (size_t idx = 0; idx < header.dir_count; idx++) {
+        DirStamp stamp;
+        std::memcpy(&stamp, mapped.data() + stamps_at + sizeof(DirStamp) * idx, sizeof(DirStamp));
+        if (!(stamp == key.stamps[idx])) {
+            return std::nullopt;
+        }
+    }
+    if (std::memcmp(mapped.data() + path_at, key.path_var.data(), header.path_length) != 0) {
+        return std::nullopt;
+    }
+
+    const char* strings = mapped.data() + strings_at;
+    std::vector<CommandInstr> instrs;
+    instrs.reserve(header.instr_count);
+    for (size_t idx = 0; idx < header.instr_count; idx++) {
+        CachedCommand cmd;
+        std::memcpy(&cmd, mapped.data() + commands_at + sizeof(CachedCommand) * idx, sizeof(CachedCommand));
+        if (uint64_t(cmd.name_offset) + cmd.name_length > header.strings_size
+            || uint64_t(cmd.path_offset) + cmd.path_length > header.strings_size) {
+            return std::nullopt;
+        }
+        instrs.push_back({
+            .id = cmd.id,
+            .name = std::string(strings + cmd.name_offset, cmd.name_length),
+            .path = std::string(strings + cmd.path_offset, cmd.path_length)
+        });
+    }
+    return instrs;
+}
+
+void MappedCommandCache::store(const CommandCacheKey& key, const std::vector<CommandInstr>& instrs) {
+    std::string strings;
+    std::vector<CachedCommand> commands;
+    commands.reserve(instrs.size());
+    for (const CommandInstr& instr : instrs) {
+        CachedCommand cmd = { .id = instr.id };
+        cmd.name_offset = strings.size();
+        cmd.name_length = instr.name.size();
+        strings += instr.name;
+        cmd.path_offset = strings.size();
+        cmd.path_length = instr.path.size();
+        strings += instr.path;
+        commands.push_back(cmd);
+    }
+
+    CommandCacheHeader header = {};
+    std::memcpy(header.magic, CMD_CACHE_MAGIC, sizeof(CMD_CACHE_MAGIC));
+    header.version = CMD_CACHE_VERSION;
+    header.dir_count = key.stamps.size();
+    header.instr_count = commands.size();
+    header.path_length = key.path_var.size();
+    header.strings_size = strings.size();
+
+    if (!make_private_dir(fs::path(this->file).parent_path())) {
+        return;
+    }
+    std::error_code err;
+    const std::string tmp_file = this->file + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(key.stamps.data()), sizeof(DirStamp) * key.stamps.size());
+        out.write(reinterpret_cast<const char*>(commands.data()), sizeof(CachedCommand) * commands.size());
+        out.write(key.path_var.data(), key.path_var.size());
+        out.write(strings.data(), strings.size());
+        if (!out) {
+            fs::remove(tmp_file, err);
+            return;
+        }
+    }
+    fs::rename(tmp_file, this->file, err);
+    if (err) {
+        fs::remove(tmp_file, err);
+    }
+}
+
+std::optional<std::string> command_cache_file(Env& env) {
+    const std::optional<std::string> dir = cache_dir(env);
+    if (!dir.has_value()) {
+        return std::nullopt;
+    }
+    return dir.value() + "/commands.bin";
+}
@@ -0,0 +1,40 @@
+#ifndef LK_CMD_CACHE
+#define LK_CMD_CACHE
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "ports.h"
+#include "cmd_instr.h"
+
+// A resolved command table is only valid for the PATH it was built from and
+// for as long as none of the PATH directories changed.
+struct CommandCacheKey {
+    std::string path_var;
+    std::vector<DirStamp> stamps;
+};
+
+class CommandCache {
+    public:
+    virtual std::optional<std::vector<CommandInstr>> load(const CommandCacheKey& key) = 0;
+    virtual void store(const CommandCacheKey& key, const std::vector<CommandInstr>& instrs) = 0;
+};
+
+// Keeps the command table in a single file that is memory mapped on load.
+// Writes go to a temporary file that is renamed over the old one, so
+// concurrent readers never see a partially written table.
+class MappedCommandCache: public CommandCache {
+    private:
+    std::string file;
+
+    public:
+    MappedCommandCache(const std::string& file) : file(file) {}
+
+    std::optional<std::vector<CommandInstr>> load(const CommandCacheKey& key);
+    void store(const CommandCacheKey& key, const std::vector<CommandInstr>& instrs);
+};
+
+std::optional<std::string> command_cache_file(Env& env);
+
+#endif
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+
+#include "cmd_cache.h"
+#include "test_util.h"
+
+namespace fs = std::filesystem;
+
+CommandCacheKey test_cache_key() {
+    return {
+        .path_var = "/usr/bin:/usr/local/bin:",
+        .stamps = {
+            { .inode = 10, .mtime_ns = 1000 },
+            { .inode = 11, .mtime_ns = 2000 }
+        }
+    };
+}
+
+std::vector<CommandInstr> test_cached_instrs() {
+    return {
+        { .id = 7, .name = "echo", .path = "/usr/bin/echo" },
+        { .id = 9, .name = "make", .path = "/usr/local/bin/make" }
+    };
+}
+
+TEST(CommandCache, LoadsWhatWasStored) {
+    MappedCommandCache cache = MappedCommandCache(temp_test_file("round_trip.bin"));
+
+    cache.store(test_cache_key(), test_cached_instrs());
+
+    EXPECT_EQ(cache.load(test_cache_key()), test_cached_instrs());
+}
+
+TEST(CommandCache, MissWhenNothingStored) {
+    MappedCommandCache cache = MappedCommandCache(temp_test_file("missing.bin"));
+
+    EXPECT_EQ(cache.load(test_cache_key()), std::nullopt);
+}
+
+TEST(CommandCache, MissWhenDirectoryChanged) {
+    MappedCommandCache cache = MappedCommandCache(temp_test_file("stale.bin"));
+    cache.store(test_cache_key(), test_cached_instrs());
+
+    CommandCacheKey key = test_cache_key();
+    key.stamps[1].mtime_ns = 3000;
+
+    EXPECT_EQ(cache.load(key), std::nullopt);
+}
+
+TEST(CommandCache, MissWhenPathChanged) {
+    MappedCommandCache cache = MappedCommandCache(temp_test_file("path.bin"));
+    cache.store(test_cache_key(), test_cached_instrs());
+
+    CommandCacheKey key = test_cache_key();
+    key.path_var = "/usr/sbin:/usr/local/bin:";
+
+    EXPECT_EQ(cache.load(key), std::nullopt);
+}
+
+TEST(CommandCache, MissWhenFileTruncated) {
+    const std::string file = temp_test_file("truncated.bin");
+    MappedCommandCache cache = MappedCommandCache(file);
+    cache.store(test_cache_key(), test_cached_instrs());
+
+    fs::resize_file(file, fs::file_size(file) - 3);
+
+    EXPECT_EQ(cache.load(test_cache_key()), std::nullopt);
+}
+
+class EmptyEnv: public Env {
+    public:
+    std::string var(const std::string&) {
+        return "";
+    }
+};
+
+TEST(CommandCache, NoCacheWithoutHome) {
+    EmptyEnv env;
+
+    EXPECT_EQ(command_cache_file(env), std::nullopt);
+}
+
+TEST(CommandCache, StoreKeepsDirectoryPrivate) {
+    const fs::path dir = temp_test_dir("private");
+    MappedCommandCache cache = MappedCommandCache(dir / "commands.bin");
+
+    cache.store(test_cache_key(), test_cached_instrs());
+
+    EXPECT_EQ(fs::status(dir).permissions() & fs::perms::all, fs::perms::owner_all);
+    EXPECT_EQ(cache.load(test_cache_key()), test_cached_instrs());
+}
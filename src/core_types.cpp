@@ -1,4 +1,6 @@
 #include<sstream>
+#include <mutex>
+#include <map>
 
 #include "core_types.h"
 
@@ -11,7 +13,16 @@ TaxStrat command_strat() {
 }
 
 TaxStrat branch_strat(std::vector<std::string> branch_instr) {
-    return { .parse_strat = ParseStrat::Branch, .block_function = BlockFunction::Routine, .branch_instr = branch_instr };
+    static std::mutex mutex;
+    static std::map<std::vector<std::string>, std::vector<Symbol>> interned;
+    const std::lock_guard<std::mutex> lock(mutex);
+    const auto found = interned.find(branch_instr);
+    if (found != interned.end()) {
+        return { .parse_strat = ParseStrat::Branch, .block_function = BlockFunction::Routine, .branch_instr = found->second };
+    }
+    const std::vector<Symbol> symbols(branch_instr.begin(), branch_instr.end());
+    const std::vector<Symbol>& stored = interned.emplace(std::move(branch_instr), symbols).first->second;
+    return { .parse_strat = ParseStrat::Branch, .block_function = BlockFunction::Routine, .branch_instr = stored };
 }
 
 TaxStrat custom_strat(BlockFunction block_func) {
@@ -22,30 +33,32 @@ InstructionID RandomIDGenerator::new_instr_id() {
     return this->distribution(this->rng);
 }
 
-BranchTaxonomy new_branch(bool is_default, const Line& input) {
+BranchTaxonomy new_branch(bool is_default, const Line& input, std::pmr::memory_resource* resource) {
     return {
 	    .default_branch = is_default,
-	    .input = input,
-		.routine = { .statements = {} }
+	    .input = copy_line(input, resource),
+		.routine = { .statements = std::pmr::vector<StatementTaxonomy>(resource) }
 	};
 }
 
 BranchTaxonomy& StatementTaxonomy::branch(bool is_default, const Line& line) {
-    this->branches.push_back(new_branch(is_default, line));
+    this->branches.push_back(new_branch(is_default, line, this->branches.get_allocator().resource()));
     return this->branches.back();
 }
 
-StatementTaxonomy new_statement(InstructionID instr_id, const Line& line) {
-	return {
-		.name = line.first_word(),
-		.input =  {line.crop_from_first_word()},
+StatementTaxonomy new_statement(InstructionID instr_id, Symbol name, const Line& line, std::pmr::memory_resource* resource) {
+	StatementTaxonomy stmt = {
+		.name = name,
+		.input = std::pmr::vector<Line>(resource),
 		.instr_id = instr_id,
-		.branches = {},
+		.branches = std::pmr::vector<BranchTaxonomy>(resource),
 	};
+	stmt.input.push_back(line.crop_from_first_word(resource));
+	return stmt;
 }
 
-StatementTaxonomy& RoutineTaxonomy::append(InstructionID instr_id, const Line& line) {
-    this->statements.push_back(new_statement(instr_id, line));
+StatementTaxonomy& RoutineTaxonomy::append(InstructionID instr_id, Symbol name, const Line& line) {
+    this->statements.push_back(new_statement(instr_id, name, line, this->statements.get_allocator().resource()));
     return this->statements.back();
 }
 
@@ -4,8 +4,11 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <memory_resource>
 #include <random>
+#include <span>
 #include "line.h"
+#include "symbol.h"
 
 typedef uint32_t InstructionID;
 
@@ -22,24 +25,30 @@ enum class BlockFunction {
     Routine
 };
 
+// Small enough to be handed out by value for every statement scanned.
 struct TaxStrat {
     ParseStrat parse_strat;
     BlockFunction block_function;
-    std::vector<std::string> branch_instr;
+    // Interned by branch_strat and never released.
+    std::span<const Symbol> branch_instr;
 };
 
 TaxStrat value_strat();
 TaxStrat command_strat();
+// Equal lists of branch instructions share one interned copy, so machines
+// can build their strategies on every lookup without growing the table.
 TaxStrat branch_strat(std::vector<std::string> branch_instr);
 TaxStrat custom_strat(BlockFunction block_func);
 
 struct BranchTaxonomy;
 
+// Taxonomy nodes allocate from the memory resource of the container they
+// are appended to, so a tree built from an arena lives entirely inside it.
 struct StatementTaxonomy {
-    std::string name;
-    std::vector<Line> input;
+    Symbol name;
+    std::pmr::vector<Line> input;
     InstructionID instr_id;
-    std::vector<BranchTaxonomy> branches;
+    std::pmr::vector<BranchTaxonomy> branches;
 
     bool operator==(const StatementTaxonomy& other) const;
     friend std::ostream& operator<<(std::ostream& os, const StatementTaxonomy& line);
@@ -48,12 +57,13 @@ struct StatementTaxonomy {
 };
 
 struct RoutineTaxonomy {
-    std::vector<StatementTaxonomy> statements;
+    std::pmr::vector<StatementTaxonomy> statements;
 
     bool operator==(const RoutineTaxonomy& other) const;
     friend std::ostream& operator<<(std::ostream& os, const RoutineTaxonomy& line);
 
-    StatementTaxonomy& append(InstructionID instr_id, const Line& line);
+    // The statement is named by the first word of line.
+    StatementTaxonomy& append(InstructionID instr_id, Symbol name, const Line& line);
 };
 
 struct BranchTaxonomy {
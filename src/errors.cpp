@@ -30,6 +30,14 @@ CompilationError unknown_instruction(size_t line_num) {
     return compile_err;
 }
 
+CompilationError unreadable_file() {
+    CompilationError compile_err = {};
+    compile_err.line_num = 0;
+    compile_err.kind = ErrorKind::UnreadableFile;
+    compile_err.message = "The script file could not be opened for reading";
+    return compile_err;
+}
+
 bool CompilationError::operator==(const CompilationError& other) const {
     return this->line_num == other.line_num
         && this->kind == other.kind
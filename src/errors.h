@@ -8,7 +8,8 @@
 enum class ErrorKind {
     InstructionDoesNotAcceptBlock,
     InvalidIndentation,
-    UnknownInstruction
+    UnknownInstruction,
+    UnreadableFile
 };
 
 struct CompilationError {
@@ -23,5 +24,6 @@ struct CompilationError {
 CompilationError instruction_does_not_accept_block(size_t line_num);
 CompilationError invalid_indentation(size_t line_num);
 CompilationError unknown_instruction(size_t line_num);
+CompilationError unreadable_file();
 
 #endif
\ No newline at end of file
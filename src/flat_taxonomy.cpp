@@ -0,0 +1,144 @@
+#include "flat_taxonomy.h"
+
+std::string_view FlatTaxonomy::str(FlatString value) const {
+    return std::string_view(this->text).substr(value.offset, value.length);
+}
+
+std::span<const FlatStatement> FlatTaxonomy::statements_in(FlatRange range) const {
+    return std::span<const FlatStatement>(this->statements).subspan(range.first, range.count);
+}
+
+std::span<const FlatBranch> FlatTaxonomy::branches_in(FlatRange range) const {
+    return std::span<const FlatBranch>(this->branches).subspan(range.first, range.count);
+}
+
+std::span<const FlatLine> FlatTaxonomy::lines_in(FlatRange range) const {
+    return std::span<const FlatLine>(this->lines).subspan(range.first, range.count);
+}
+
+std::span<const FlatToken> FlatTaxonomy::tokens_in(FlatRange range) const {
+    return std::span<const FlatToken>(this->tokens).subspan(range.first, range.count);
+}
+
+FlatString add_text(FlatTaxonomy& flat, std::string_view value) {
+    if (value.empty()) {
+        return { .offset = 0, .length = 0 };
+    }
+    const FlatString str = { .offset = uint32_t(flat.text.size()), .length = uint32_t(value.size()) };
+    flat.text.append(value);
+    return str;
+}
+
+uint32_t add_line(FlatTaxonomy& flat, const Line& line) {
+    flat.lines.push_back({
+        .line_num = line.line_num,
+        .start = line.start,
+        .end = line.end,
+        .word_start = line.word_start,
+        .tokens = { .first = uint32_t(flat.tokens.size()), .count = uint32_t(line.tokens.size()) }
+    });
+    for (const LineToken& token : line.tokens) {
+        flat.tokens.push_back({
+            .kind = token.kind,
+            .quote_mark = token.quote_mark,
+            .flag_dashes = token.flag_dashes,
+            .value = add_text(flat, token.value())
+        });
+    }
+    return flat.lines.size() - 1;
+}
+
+FlatRange flatten_routine(const RoutineTaxonomy& routine, FlatTaxonomy& flat);
+
+FlatStatement flatten_statement(const StatementTaxonomy& stmt, FlatTaxonomy& flat) {
+    FlatStatement row = {
+        .name = add_text(flat, stmt.name.str()),
+        .instr_id = stmt.instr_id,
+        .input = { .first = uint32_t(flat.lines.size()), .count = uint32_t(stmt.input.size()) },
+        .branches = { .first = uint32_t(flat.branches.size()), .count = uint32_t(stmt.branches.size()) }
+    };
+    for (const Line& line : stmt.input) {
+        add_line(flat, line);
+    }
+    // Claim the rows of the branches before their routines add rows of their own.
+    flat.branches.resize(flat.branches.size() + stmt.branches.size());
+    for (size_t idx = 0; idx < stmt.branches.size(); idx++) {
+        const BranchTaxonomy& branch = stmt.branches[idx];
+        const FlatBranch branch_row = {
+            .default_branch = branch.default_branch,
+            .input = add_line(flat, branch.input),
+            .routine = flatten_routine(branch.routine, flat)
+        };
+        flat.branches[row.branches.first + idx] = branch_row;
+    }
+    return row;
+}
+
+FlatRange flatten_routine(const RoutineTaxonomy& routine, FlatTaxonomy& flat) {
+    const FlatRange range = { .first = uint32_t(flat.statements.size()), .count = uint32_t(routine.statements.size()) };
+    flat.statements.resize(flat.statements.size() + routine.statements.size());
+    for (size_t idx = 0; idx < routine.statements.size(); idx++) {
+        const FlatStatement row = flatten_statement(routine.statements[idx], flat);
+        flat.statements[range.first + idx] = row;
+    }
+    return range;
+}
+
+FlatTaxonomy flatten(const FileTaxonomy& file) {
+    FlatTaxonomy flat = {};
+    flat.routine = flatten_routine(file.routine, flat);
+    flat.errors = file.errors;
+    flat.statement_lines.assign(file.statement_lines.begin(), file.statement_lines.end());
+    return flat;
+}
+
+Line unflatten_line(const FlatTaxonomy& flat, const FlatLine& row, std::pmr::memory_resource* resource) {
+    Line line = {
+        .line_num = row.line_num,
+        .start = row.start,
+        .end = row.end,
+        .word_start = row.word_start,
+        .tokens = std::pmr::vector<LineToken>(resource)
+    };
+    line.tokens.reserve(row.tokens.count);
+    for (const FlatToken& token : flat.tokens_in(row.tokens)) {
+        line.tokens.emplace_back(token.kind, flat.str(token.value), token.quote_mark, token.flag_dashes);
+    }
+    return line;
+}
+
+void unflatten_routine(const FlatTaxonomy& flat, FlatRange range, RoutineTaxonomy& routine) {
+    std::pmr::memory_resource* resource = routine.statements.get_allocator().resource();
+    routine.statements.reserve(range.count);
+    for (const FlatStatement& row : flat.statements_in(range)) {
+        StatementTaxonomy stmt = {
+            .name = Symbol(flat.str(row.name)),
+            .input = std::pmr::vector<Line>(resource),
+            .instr_id = row.instr_id,
+            .branches = std::pmr::vector<BranchTaxonomy>(resource)
+        };
+        stmt.input.reserve(row.input.count);
+        for (const FlatLine& line : flat.lines_in(row.input)) {
+            stmt.input.push_back(unflatten_line(flat, line, resource));
+        }
+        stmt.branches.reserve(row.branches.count);
+        for (const FlatBranch& branch_row : flat.branches_in(row.branches)) {
+            BranchTaxonomy branch = {
+                .default_branch = branch_row.default_branch,
+                .input = unflatten_line(flat, flat.lines[branch_row.input], resource),
+                .routine = { .statements = std::pmr::vector<StatementTaxonomy>(resource) }
+            };
+            unflatten_routine(flat, branch_row.routine, branch.routine);
+            stmt.branches.push_back(std::move(branch));
+        }
+        routine.statements.push_back(std::move(stmt));
+    }
+}
+
+FileTaxonomy unflatten(const FlatTaxonomy& flat) {
+    FileTaxonomy file = arena_file_taxonomy();
+    unflatten_routine(flat, flat.routine, file.routine);
+    file.errors = flat.errors;
+    file.statement_lines.assign(flat.statement_lines.begin(), flat.statement_lines.end());
+    return file;
+}
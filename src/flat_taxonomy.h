@@ -0,0 +1,87 @@
+#ifndef LK_FLAT_TAXONOMY
+#define LK_FLAT_TAXONOMY
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+
+#include "errors.h"
+#include "core_types.h"
+#include "taxscan.h"
+
+// Slice of FlatTaxonomy::text.
+struct FlatString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Contiguous rows of one of the FlatTaxonomy tables.
+struct FlatRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct FlatToken {
+    TokenKind kind;
+    // LineToken::quote_mark and LineToken::flag_dashes.
+    char quote_mark;
+    uint8_t flag_dashes;
+    FlatString value;
+};
+
+struct FlatLine {
+    int32_t line_num;
+    int32_t start;
+    int32_t end;
+    int32_t word_start;
+    // Rows of FlatTaxonomy::tokens.
+    FlatRange tokens;
+};
+
+struct FlatStatement {
+    FlatString name;
+    InstructionID instr_id;
+    // Rows of FlatTaxonomy::lines.
+    FlatRange input;
+    // Rows of FlatTaxonomy::branches.
+    FlatRange branches;
+};
+
+struct FlatBranch {
+    bool default_branch;
+    // Row of FlatTaxonomy::lines.
+    uint32_t input;
+    // Rows of FlatTaxonomy::statements.
+    FlatRange routine;
+};
+
+// FileTaxonomy stored as plain tables that refer to each other by row.
+// The statements of a routine, the branches of a statement and the lines
+// of an input are each contiguous, so walking the tree never leaves the
+// tables and the tables can be written out as they are.
+struct FlatTaxonomy {
+    // Rows of statements making up the routine of the file.
+    FlatRange routine;
+    std::vector<FlatStatement> statements;
+    std::vector<FlatBranch> branches;
+    std::vector<FlatLine> lines;
+    std::vector<FlatToken> tokens;
+    std::string text;
+    std::vector<CompilationError> errors;
+    // FileTaxonomy::statement_lines.
+    std::vector<int32_t> statement_lines;
+
+    std::string_view str(FlatString value) const;
+    std::span<const FlatStatement> statements_in(FlatRange range) const;
+    std::span<const FlatBranch> branches_in(FlatRange range) const;
+    std::span<const FlatLine> lines_in(FlatRange range) const;
+    std::span<const FlatToken> tokens_in(FlatRange range) const;
+};
+
+FlatTaxonomy flatten(const FileTaxonomy& file);
+// Rebuilds the tree in a fresh arena owned by the returned taxonomy.
+FileTaxonomy unflatten(const FlatTaxonomy& flat);
+
+#endif
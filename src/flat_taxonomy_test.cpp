@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <optional>
+
+#include "flat_taxonomy.h"
+
+class FlatStateMachine: public StateMachine {
+    public:
+    std::optional<InstructionID> find_instr(const std::string& name) {
+        if (name == "if") {
+            return 1;
+        }
+        if (name == "print") {
+            return 2;
+        }
+        if (name == "hexdump") {
+            return 3;
+        }
+        return std::nullopt;
+    }
+
+    TaxStrat tax_strat(InstructionID instr) {
+        if (instr == 1) {
+            return branch_strat({"else"});
+        }
+        if (instr == 3) {
+            return custom_strat(BlockFunction::Append);
+        }
+        return command_strat();
+    }
+};
+
+TEST(FlatTaxonomy, RoundTripsScannedScript) {
+    FlatStateMachine machine;
+    const FileTaxonomy file = scan_file({
+        "print 'A' --verbose",
+        "if true",
+        "	print 'B'",
+        "	if nested",
+        "		hexdump",
+        "			00 01 02",
+        "		end",
+        "else",
+        "	print `C`",
+        "print 'D'"
+    }, machine);
+
+    EXPECT_EQ(unflatten(flatten(file)), file);
+}
+
+TEST(FlatTaxonomy, RoundTripsErrors) {
+    FlatStateMachine machine;
+    const FileTaxonomy file = scan_file({ "print 'A'", "missing" }, machine);
+
+    EXPECT_EQ(unflatten(flatten(file)), file);
+}
+
+TEST(FlatTaxonomy, ChildrenAreContiguousRows) {
+    FlatStateMachine machine;
+    const FlatTaxonomy flat = flatten(scan_file({
+        "print 'A'",
+        "if true",
+        "	print 'B'",
+        "	print 'C'",
+        "else",
+        "	print 'D'",
+        "print 'E'"
+    }, machine));
+
+    ASSERT_EQ(flat.routine.first, 0);
+    ASSERT_EQ(flat.routine.count, 3);
+    const FlatStatement& branching = flat.statements_in(flat.routine)[1];
+    EXPECT_EQ(flat.str(branching.name), "if");
+    ASSERT_EQ(branching.branches.count, 2);
+
+    const FlatBranch& then_branch = flat.branches_in(branching.branches)[0];
+    EXPECT_TRUE(then_branch.default_branch);
+    EXPECT_EQ(then_branch.routine.first, 3);
+    EXPECT_EQ(then_branch.routine.count, 2);
+
+    const FlatBranch& else_branch = flat.branches_in(branching.branches)[1];
+    EXPECT_FALSE(else_branch.default_branch);
+    EXPECT_EQ(else_branch.routine.first, 5);
+    EXPECT_EQ(else_branch.routine.count, 1);
+
+    const FlatStatement& last = flat.statements_in(else_branch.routine)[0];
+    const FlatLine& input = flat.lines_in(last.input)[0];
+    EXPECT_EQ(input.line_num, 6);
+    EXPECT_EQ(flat.str(flat.tokens_in(input.tokens)[2].value), "D");
+    EXPECT_EQ(flat.tokens_in(input.tokens)[2].kind, TokenKind::Word);
+}
@@ -0,0 +1,35 @@
+#include <cstring>
+
+#include "hash.h"
+
+const uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+
+// Finalizer of MurmurHash3, every input bit affects every output bit.
+uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t content_hash(std::string_view data, uint64_t seed) {
+    uint64_t hash = mix(seed ^ (data.size() * HASH_MULTIPLIER));
+    size_t idx = 0;
+    for (; idx + sizeof(uint64_t) <= data.size(); idx += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + idx, sizeof(word));
+        hash = (hash ^ mix(word)) * HASH_MULTIPLIER;
+    }
+    if (idx < data.size()) {
+        uint64_t word = 0;
+        std::memcpy(&word, data.data() + idx, data.size() - idx);
+        hash = (hash ^ mix(word)) * HASH_MULTIPLIER;
+    }
+    return mix(hash);
+}
+
+uint64_t content_hash(uint64_t value, uint64_t seed) {
+    return mix((seed ^ mix(value)) * HASH_MULTIPLIER);
+}
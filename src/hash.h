@@ -0,0 +1,12 @@
+#ifndef LK_HASH
+#define LK_HASH
+
+#include <cstdint>
+#include <string_view>
+
+// Fast non cryptographic 64 bit hash, used to key caches on file contents.
+// Pass the previous hash as seed to hash several values in sequence.
+uint64_t content_hash(std::string_view data, uint64_t seed = 0);
+uint64_t content_hash(uint64_t value, uint64_t seed);
+
+#endif
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "lexer.h"
+
+bool TokenView::operator==(const TokenView& other) const {
+    return this->kind == other.kind
+        && this->quote_mark == other.quote_mark
+        && this->flag_dashes == other.flag_dashes
+        && this->flags == other.flags
+        && this->offset == other.offset
+        && this->length == other.length;
+}
+
+TokenKind char_kind(char c) {
+    const CharClass cls = char_class(c);
+    if (cls == CharClass::Word) {
+        return TokenKind::Word;
+    }
+    if (cls == CharClass::Whitespace) {
+        return TokenKind::Whitespace;
+    }
+    return TokenKind::Symbol;
+}
+
+TokenView view_token(TokenKind kind, size_t offset, size_t length) {
+    return { .kind = kind, .quote_mark = 0, .flag_dashes = 0, .flags = 0, .offset = uint32_t(offset), .length = uint32_t(length) };
+}
+
+// Extends the previous token when it is of the same kind, which only happens
+// when the two runs were split by backquotes.
+void push_run(std::vector<TokenView>& tokens, size_t first, TokenKind kind, size_t start, size_t end) {
+    if (tokens.size() > first && kind != TokenKind::Symbol && tokens.back().kind == kind) {
+        TokenView& current = tokens.back();
+        if (current.offset + current.length != start) {
+            current.flags |= TOKEN_BACKQUOTED;
+        }
+        current.length = end - current.offset;
+        return;
+    }
+    tokens.push_back(view_token(kind, start, end - start));
+}
+
+// Pushes the quote opened by the mark at idx and moves idx past its closing
+// mark. Backquoted text inside the quote is skipped like everywhere else,
+// a mark between backquotes neither closes the quote nor is escaped.
+bool lex_quote(std::string_view text, size_t& idx, std::vector<TokenView>& tokens) {
+    const char* data = text.data();
+    const size_t size = text.size();
+    const char mark = data[idx];
+    uint8_t flags = 0;
+    size_t pos = idx + 1;
+    while (pos < size) {
+        const char c = data[pos];
+        if (c == mark) {
+            TokenView quote = view_token(TokenKind::Quote, idx + 1, pos - idx - 1);
+            quote.quote_mark = mark;
+            quote.flags = flags;
+            tokens.push_back(quote);
+            idx = pos + 1;
+            return true;
+        }
+        if (c == '`') {
+            const char* closing = static_cast<const char*>(std::memchr(data + pos + 1, '`', size - pos - 1));
+            if (closing == nullptr) {
+                return false;
+            }
+            flags |= TOKEN_BACKQUOTED;
+            pos = closing - data + 1;
+            continue;
+        }
+        if (c == '\\' && pos + 1 < size && data[pos + 1] == mark) {
+            flags |= TOKEN_ESCAPED;
+            pos += 2;
+            continue;
+        }
+        pos++;
+    }
+    return false;
+}
+
+// Pushes the flag whose dashes start at idx and moves idx past its name.
+bool lex_flag(std::string_view text, size_t& idx, std::vector<TokenView>& tokens, RunEndFinder run_end) {
+    const char* data = text.data();
+    const size_t size = text.size();
+    size_t pos = idx;
+    while (pos < size && data[pos] == '-') {
+        pos++;
+    }
+    const size_t dashes = pos - idx;
+    const size_t name_start = pos;
+    uint8_t flags = 0;
+    bool has_word = false;
+    while (pos < size) {
+        const CharClass cls = char_class(data[pos]);
+        if (cls == CharClass::Word) {
+            pos = run_end(data, pos + 1, size, cls);
+            has_word = true;
+            continue;
+        }
+        if (cls == CharClass::Backquote) {
+            const char* closing = static_cast<const char*>(std::memchr(data + pos + 1, '`', size - pos - 1));
+            const size_t end = closing == nullptr ? size : closing - data;
+            has_word = has_word || end > pos + 1;
+            flags |= TOKEN_BACKQUOTED;
+            pos = std::min(end + 1, size);
+            continue;
+        }
+        if (data[pos] == '-' && has_word) {
+            pos++;
+            continue;
+        }
+        break;
+    }
+    if (!has_word || dashes > UINT8_MAX) {
+        return false;
+    }
+    TokenView flag = view_token(TokenKind::Flag, name_start, pos - name_start);
+    flag.flag_dashes = dashes;
+    flag.flags = flags;
+    tokens.push_back(flag);
+    idx = pos;
+    return true;
+}
+
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, RunEndFinder run_end) {
+    lex_line(text, tokens, run_end, {});
+}
+
+// Same rules as the tokenizer always had: runs of word or whitespace
+// characters form one token, every symbol is a token of its own and
+// anything between backquotes is part of a word. Runs are found a vector
+// register at a time where the CPU allows it. Quotes and flags can only
+// start at a symbol, so they cost nothing on the other characters.
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, RunEndFinder run_end, const LexOptions& options) {
+    const size_t first = tokens.size();
+    const char* data = text.data();
+    const size_t size = text.size();
+    // Once a mark is found not to close, no later mark of the same kind
+    // closes either, so each kind is searched to the end at most once.
+    bool single_unclosed = false;
+    bool double_unclosed = false;
+    size_t idx = 0;
+    while (idx < size) {
+        const CharClass cls = char_class(data[idx]);
+        if (cls == CharClass::Backquote) {
+            const char* closing = static_cast<const char*>(std::memchr(data + idx + 1, '`', size - idx - 1));
+            const size_t end = closing == nullptr ? size : closing - data;
+            if (end > idx + 1) {
+                push_run(tokens, first, TokenKind::Word, idx + 1, end);
+            }
+            idx = end + 1;
+            continue;
+        }
+        if (cls == CharClass::Symbol) {
+            const char c = data[idx];
+            if (options.quotes && (c == '\'' || c == '"')) {
+                bool& unclosed = c == '\'' ? single_unclosed : double_unclosed;
+                if (!unclosed && lex_quote(text, idx, tokens)) {
+                    continue;
+                }
+                unclosed = true;
+            }
+            const bool token_start = tokens.size() == first || tokens.back().kind == TokenKind::Whitespace;
+            if (options.flags && c == '-' && token_start && lex_flag(text, idx, tokens, run_end)) {
+                continue;
+            }
+            push_run(tokens, first, TokenKind::Symbol, idx, idx + 1);
+            idx++;
+            continue;
+        }
+        const size_t end = run_end(data, idx + 1, size, cls);
+        push_run(tokens, first, cls == CharClass::Word ? TokenKind::Word : TokenKind::Whitespace, idx, end);
+        idx = end;
+    }
+}
+
+void lex_line(std::string_view text, std::vector<TokenView>& tokens) {
+    lex_line(text, tokens, LexOptions{});
+}
+
+// Script runs are mostly a few characters long, too short for the vector
+// paths to make up for their setup at any line length, so lines are lexed
+// with the scalar finder. Callers that know their lines have long runs can
+// pass run_end_finder(detected_isa()) to the overload taking a finder.
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, const LexOptions& options) {
+    static const RunEndFinder scalar_run_end = run_end_finder(CharClassIsa::Scalar);
+    lex_line(text, tokens, scalar_run_end, options);
+}
+
+void lex(const std::vector<std::string>& lines_raw, LexedSource& lexed, const LexOptions& options) {
+    lex(lines_raw, 0, lines_raw.size(), lexed, options);
+}
+
+void lex(const std::vector<std::string>& lines_raw, size_t first, size_t last, LexedSource& lexed, const LexOptions& options) {
+    lexed.lines.reserve(lexed.lines.size() + last - first);
+    for (size_t idx = first; idx < last; idx++) {
+        const size_t first_token = lexed.tokens.size();
+        lex_line(lines_raw[idx], lexed.tokens, options);
+        lexed.lines.push_back({
+            .line_num = int(idx + 1),
+            .text = lines_raw[idx],
+            .first_token = uint32_t(first_token),
+            .token_count = uint32_t(lexed.tokens.size() - first_token)
+        });
+    }
+}
+
+void lex(std::string_view source, LexedSource& lexed, const LexOptions& options) {
+    const char* data = source.data();
+    const size_t size = source.size();
+    size_t line_start = 0;
+    int line_num = 1;
+    while (line_start < size) {
+        const char* newline = static_cast<const char*>(std::memchr(data + line_start, '\n', size - line_start));
+        const size_t line_end = newline == nullptr ? size : newline - data;
+        const std::string_view text = source.substr(line_start, line_end - line_start);
+        const size_t first_token = lexed.tokens.size();
+        lex_line(text, lexed.tokens, options);
+        lexed.lines.push_back({
+            .line_num = line_num,
+            .text = text,
+            .first_token = uint32_t(first_token),
+            .token_count = uint32_t(lexed.tokens.size() - first_token)
+        });
+        line_start = line_end + 1;
+        line_num++;
+    }
+}
+
+std::string token_value(std::string_view text, const TokenView& token) {
+    const std::string_view raw = text.substr(token.offset, token.length);
+    if ((token.flags & (TOKEN_BACKQUOTED | TOKEN_ESCAPED)) == 0) {
+        return std::string(raw);
+    }
+    std::string value;
+    value.reserve(raw.size());
+    bool in_backquotes = false;
+    for (size_t idx = 0; idx < raw.size(); idx++) {
+        const char c = raw[idx];
+        if (c == '`') {
+            in_backquotes = !in_backquotes;
+            continue;
+        }
+        const bool escape = !in_backquotes
+            && c == '\\'
+            && token.quote_mark != 0
+            && idx + 1 < raw.size()
+            && raw[idx + 1] == token.quote_mark;
+        if (!escape) {
+            value += c;
+        }
+    }
+    return value;
+}
+
+// Only tokens with backquotes or escapes need their value built, the rest
+// are copied straight out of the line.
+LineToken materialize_token(std::string_view text, const TokenView& token) {
+    if ((token.flags & (TOKEN_BACKQUOTED | TOKEN_ESCAPED)) == 0) {
+        return LineToken(token.kind, text.substr(token.offset, token.length), token.quote_mark, token.flag_dashes);
+    }
+    return LineToken(token.kind, token_value(text, token), token.quote_mark, token.flag_dashes);
+}
+
+Line materialize(
+    int line_num,
+    std::string_view text,
+    const TokenView* tokens,
+    size_t count,
+    std::pmr::memory_resource* resource
+) {
+    LineBuilder line(line_num, resource);
+    line.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        line.push(materialize_token(text, tokens[idx]));
+    }
+    return line.build();
+}
+
+void materialize_into(Line& line, std::string_view text, const TokenView* tokens, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        line.push(materialize_token(text, tokens[idx]));
+    }
+}
+
+Line materialize(const LexedSource& lexed, size_t line_idx, std::pmr::memory_resource* resource) {
+    const LexedLine& line = lexed.lines[line_idx];
+    return materialize(line.line_num, line.text, lexed.tokens.data() + line.first_token, line.token_count, resource);
+}
@@ -0,0 +1,88 @@
+#ifndef LK_LEXER
+#define LK_LEXER
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "line.h"
+#include "char_class.h"
+
+// Set on a token whose source range contains backquotes, which are not part
+// of the token's value.
+const uint8_t TOKEN_BACKQUOTED = 1;
+// Set on a quote whose source range contains its quote mark escaped by a
+// backslash, the backslash is not part of the token's value.
+const uint8_t TOKEN_ESCAPED = 2;
+
+// What the lexer recognizes on top of words, whitespace and symbols, in
+// the same pass over the line.
+struct LexOptions {
+    // Quotes run from a ' or " to the next same mark that is not escaped
+    // by a backslash. A mark that is not closed on its line is a symbol.
+    bool quotes = false;
+    // Flags are dashes at the start of a token followed by a word, their
+    // name runs over words and dashes up to any other character.
+    bool flags = false;
+};
+
+// A token that does not own its text, it is the range [offset, offset + length)
+// of the line it was lexed from.
+struct TokenView {
+    TokenKind kind;
+    char quote_mark;
+    uint8_t flag_dashes;
+    uint8_t flags;
+    uint32_t offset;
+    uint32_t length;
+
+    bool operator==(const TokenView& other) const;
+};
+
+struct LexedLine {
+    int line_num;
+    std::string_view text;
+    uint32_t first_token;
+    uint32_t token_count;
+};
+
+// Tokens of every line share one vector, lexing a script only allocates when
+// that vector or the line table grows.
+struct LexedSource {
+    std::vector<LexedLine> lines;
+    std::vector<TokenView> tokens;
+};
+
+TokenKind char_kind(char c);
+void lex_line(std::string_view text, std::vector<TokenView>& tokens);
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, const LexOptions& options);
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, RunEndFinder run_end);
+void lex_line(std::string_view text, std::vector<TokenView>& tokens, RunEndFinder run_end, const LexOptions& options);
+void lex(const std::vector<std::string>& lines_raw, LexedSource& lexed, const LexOptions& options = {});
+// Lexes lines_raw[first, last), numbered by their index in lines_raw.
+void lex(const std::vector<std::string>& lines_raw, size_t first, size_t last, LexedSource& lexed, const LexOptions& options = {});
+// Splits source on newlines itself, the lines of lexed point into source.
+void lex(std::string_view source, LexedSource& lexed, const LexOptions& options = {});
+
+std::string token_value(std::string_view text, const TokenView& token);
+// Materialized tokens are allocated from resource, which must outlive the Line.
+Line materialize(
+    int line_num,
+    std::string_view text,
+    const TokenView* tokens,
+    size_t count,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+);
+// Appends the tokens to line, keeping its start and end up to date as it goes.
+void materialize_into(Line& line, std::string_view text, const TokenView* tokens, size_t count);
+// Lexes and materializes one line with quotes and flags as options asks,
+// instead of running parse_quotes and parse_flags over a parsed line.
+Line parse(int line_num, std::string_view text, const LexOptions& options);
+Line materialize(
+    const LexedSource& lexed,
+    size_t line_idx,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+);
+
+#endif
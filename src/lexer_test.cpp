@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include <cctype>
+
+#include "lexer.h"
+
+TokenView view(TokenKind kind, uint32_t offset, uint32_t length) {
+    return { .kind = kind, .quote_mark = 0, .flag_dashes = 0, .flags = 0, .offset = offset, .length = length };
+}
+
+TEST(Lexer, TokensAreRangesOfTheLine) {
+    std::vector<TokenView> tokens;
+    lex_line("  print data+=1", tokens);
+
+    std::vector<TokenView> expected = {
+        view(TokenKind::Whitespace, 0, 2),
+        view(TokenKind::Word, 2, 5),
+        view(TokenKind::Whitespace, 7, 1),
+        view(TokenKind::Word, 8, 4),
+        view(TokenKind::Symbol, 12, 1),
+        view(TokenKind::Symbol, 13, 1),
+        view(TokenKind::Word, 14, 1)
+    };
+    EXPECT_EQ(tokens, expected);
+}
+
+TEST(Lexer, BackquotesAreMarkedAndStripped) {
+    const std::string text = "a`b c`d `}`";
+    std::vector<TokenView> tokens;
+    lex_line(text, tokens);
+
+    TokenView word = view(TokenKind::Word, 0, 7);
+    word.flags = TOKEN_BACKQUOTED;
+    std::vector<TokenView> expected = {
+        word,
+        view(TokenKind::Whitespace, 7, 1),
+        view(TokenKind::Word, 9, 1)
+    };
+    EXPECT_EQ(tokens, expected);
+    EXPECT_EQ(token_value(text, tokens[0]), "ab cd");
+    EXPECT_EQ(token_value(text, tokens[2]), "}");
+}
+
+TEST(Lexer, LinesShareOneTokenBuffer) {
+    std::vector<std::string> lines_raw = {"print 'a'", "", "exit"};
+    LexedSource lexed;
+    lex(lines_raw, lexed);
+
+    ASSERT_EQ(lexed.lines.size(), 3);
+    EXPECT_EQ(lexed.tokens.size(), 6);
+    EXPECT_EQ(lexed.lines[0].first_token, 0);
+    EXPECT_EQ(lexed.lines[0].token_count, 5);
+    EXPECT_EQ(lexed.lines[1].token_count, 0);
+    EXPECT_EQ(lexed.lines[2].first_token, 5);
+    EXPECT_EQ(lexed.lines[2].line_num, 3);
+}
+
+TEST(Lexer, MaterializesToParsedLine) {
+    std::vector<std::string> lines_raw = {"\t| echo `clang++` {", "  if true"};
+    LexedSource lexed;
+    lex(lines_raw, lexed);
+
+    EXPECT_EQ(materialize(lexed, 0), parse(1, lines_raw[0]));
+    EXPECT_EQ(materialize(lexed, 1), parse(2, lines_raw[1]));
+}
+
+// The per character tokenizer the lexer replaced, kept as a reference.
+std::pmr::vector<LineToken> reference_tokens(const std::string& value) {
+    std::pmr::vector<LineToken> tokens;
+    bool in_backquotes = false;
+    bool has_current = false;
+    for (char c : value) {
+        if (c == '`') {
+            in_backquotes = !in_backquotes;
+            continue;
+        }
+        TokenKind kind = TokenKind::Symbol;
+        if (in_backquotes || std::isalpha(static_cast<unsigned char>(c)) || std::isdigit(static_cast<unsigned char>(c)) || c == '_') {
+            kind = TokenKind::Word;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            kind = TokenKind::Whitespace;
+        }
+        if (!has_current || kind == TokenKind::Symbol || tokens.back().kind != kind) {
+            tokens.push_back(LineToken(kind, std::string(1, c)));
+            has_current = true;
+            continue;
+        }
+        tokens.back() = LineToken(kind, std::string(tokens.back().value()) + c);
+    }
+    return tokens;
+}
+
+std::vector<CharClassIsa> supported_isas() {
+    std::vector<CharClassIsa> isas = {CharClassIsa::Scalar};
+    if (detected_isa() == CharClassIsa::Sse2 || detected_isa() == CharClassIsa::Avx2) {
+        isas.push_back(CharClassIsa::Sse2);
+    }
+    if (detected_isa() == CharClassIsa::Avx2) {
+        isas.push_back(CharClassIsa::Avx2);
+    }
+    return isas;
+}
+
+TEST(Lexer, EveryInstructionSetMatchesReference) {
+    const std::string alphabet = "aZ_09 \t\r\v+-'\"`#{}\x80\xff";
+    uint32_t seed = 12345;
+    for (size_t round = 0; round < 2000; round++) {
+        std::string text;
+        const size_t length = round % 97;
+        for (size_t idx = 0; idx < length; idx++) {
+            seed = seed * 1103515245 + 12345;
+            const char c = alphabet[(seed >> 16) % alphabet.size()];
+            text.append(seed % 3 == 0 ? 20 : 1, c);
+        }
+        const std::pmr::vector<LineToken> expected = reference_tokens(text);
+        for (CharClassIsa isa : supported_isas()) {
+            std::vector<TokenView> tokens;
+            lex_line(text, tokens, run_end_finder(isa));
+            EXPECT_EQ(materialize(1, text, tokens.data(), tokens.size()).tokens, expected) << text;
+        }
+    }
+}
+
+TEST(CharClass, MatchesCLocale) {
+    for (int c = 0; c < 256; c++) {
+        CharClass expected = CharClass::Symbol;
+        if (c == '`') {
+            expected = CharClass::Backquote;
+        } else if (std::isalnum(c) || c == '_') {
+            expected = CharClass::Word;
+        } else if (std::isspace(c)) {
+            expected = CharClass::Whitespace;
+        }
+        EXPECT_EQ(char_class(char(c)), expected) << c;
+    }
+}
+
+TEST(Lexer, SplitsSourceIntoLines) {
+    const std::string source = "print 'a'\n\n  exit\n";
+    LexedSource lexed;
+    lex(source, lexed);
+
+    ASSERT_EQ(lexed.lines.size(), 3);
+    EXPECT_EQ(lexed.lines[0].text, "print 'a'");
+    EXPECT_EQ(lexed.lines[1].text, "");
+    EXPECT_EQ(lexed.lines[2].text, "  exit");
+    EXPECT_EQ(lexed.lines[2].line_num, 3);
+    EXPECT_EQ(materialize(lexed, 2), parse(3, "  exit"));
+}
+
+TEST(Lexer, LastLineWithoutNewline) {
+    LexedSource lexed;
+    lex(std::string_view("a\nb"), lexed);
+
+    ASSERT_EQ(lexed.lines.size(), 2);
+    EXPECT_EQ(lexed.lines[1].text, "b");
+}
+
+TEST(Lexer, QuotesAreOneToken) {
+    const std::string text = "say 'a b' \"c\\\"d\"";
+    std::vector<TokenView> tokens;
+    lex_line(text, tokens, { .quotes = true });
+
+    TokenView single = view(TokenKind::Quote, 5, 3);
+    single.quote_mark = '\'';
+    TokenView escaped = view(TokenKind::Quote, 11, 4);
+    escaped.quote_mark = '"';
+    escaped.flags = TOKEN_ESCAPED;
+    std::vector<TokenView> expected = {
+        view(TokenKind::Word, 0, 3),
+        view(TokenKind::Whitespace, 3, 1),
+        single,
+        view(TokenKind::Whitespace, 9, 1),
+        escaped
+    };
+    EXPECT_EQ(tokens, expected);
+    EXPECT_EQ(token_value(text, tokens[2]), "a b");
+    EXPECT_EQ(token_value(text, tokens[4]), "c\"d");
+}
+
+TEST(Lexer, UnclosedQuoteMarksAreSymbols) {
+    EXPECT_EQ(parse(1, "it's `'`", { .quotes = true }), parse(1, "it's `'`"));
+    EXPECT_EQ(parse(1, "say 'a `b' c", { .quotes = true }), parse(1, "say 'a `b' c"));
+}
+
+TEST(Lexer, FlagsStartTokens) {
+    const Line actual = parse(1, "ping -c 1 --co-unt x-y - --", { .flags = true });
+
+    const std::vector<LineToken> expected = {
+        word_token("ping"),
+        whitespace_token(" "),
+        flag_token("c", "-"),
+        whitespace_token(" "),
+        word_token("1"),
+        whitespace_token(" "),
+        flag_token("co-unt", "--"),
+        whitespace_token(" "),
+        word_token("x"),
+        symbol_token("-"),
+        word_token("y"),
+        whitespace_token(" "),
+        symbol_token("-"),
+        whitespace_token(" "),
+        symbol_token("-"),
+        symbol_token("-")
+    };
+    EXPECT_EQ(std::vector<LineToken>(actual.tokens.begin(), actual.tokens.end()), expected);
+    EXPECT_EQ(actual.end, 15);
+}
+
+TEST(Lexer, OnePassMatchesQuoteAndFlagPasses) {
+    const std::vector<std::string> lines = {
+        "stdout 'Hello World'",
+        "stdout \"Hello W\\\"orld\"",
+        "stdout 'Hello W\\'orld'",
+        "stdout \"Hello \" 'W o r l d'",
+        "ping -c 1 foo",
+        "ping --co-unt 1 foo",
+        "ping -d --count 1 -fc foo --out file",
+        "curl --header 'Accept: json' -X `POST` --`data`-raw '`a'b`'"
+    };
+    for (const std::string& text : lines) {
+        EXPECT_EQ(parse(1, text, { .quotes = true, .flags = true }), parse_flags(parse_quotes(parse(1, text)))) << text;
+    }
+}
@@ -1,16 +1,108 @@
 
 #include <cctype>
+#include <cstring>
+#include <atomic>
+#include <new>
 #include <vector>
 #include <sstream>
+#include <algorithm>
 #include "line.h"
+#include "lexer.h"
+#include "thread_pool.h"
 
-const std::string EMPTY_WORD = "";
+static_assert(sizeof(LineToken) == 16);
+
+// Header of the block holding a long token value, the value follows it.
+struct TokenText {
+    std::atomic<uint32_t> refs;
+};
+
+char* text_chars(TokenText* text) {
+    return reinterpret_cast<char*>(text + 1);
+}
+
+LineToken::LineToken(TokenKind kind, std::string_view value, char quote_mark, uint8_t flag_dashes) :
+    kind(kind),
+    quote_mark(quote_mark),
+    flag_dashes(flag_dashes),
+    length(value.size()) {
+    if (value.size() <= TOKEN_INLINE_CHARS) {
+        std::memcpy(this->chars, value.data(), value.size());
+        return;
+    }
+    this->text = new (::operator new(sizeof(TokenText) + value.size())) TokenText{ .refs = 1 };
+    std::memcpy(text_chars(this->text), value.data(), value.size());
+}
+
+LineToken::LineToken(const LineToken& other) :
+    kind(other.kind),
+    quote_mark(other.quote_mark),
+    flag_dashes(other.flag_dashes),
+    length(other.length) {
+    std::memcpy(this->chars, other.chars, TOKEN_INLINE_CHARS);
+    if (this->length > TOKEN_INLINE_CHARS) {
+        this->text->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// The moved from token is left holding an empty value.
+LineToken::LineToken(LineToken&& other) noexcept :
+    kind(other.kind),
+    quote_mark(other.quote_mark),
+    flag_dashes(other.flag_dashes),
+    length(other.length) {
+    std::memcpy(this->chars, other.chars, TOKEN_INLINE_CHARS);
+    other.length = 0;
+}
+
+LineToken& LineToken::operator=(const LineToken& other) {
+    if (this != &other) {
+        this->release();
+        new (this) LineToken(other);
+    }
+    return *this;
+}
+
+LineToken& LineToken::operator=(LineToken&& other) noexcept {
+    if (this != &other) {
+        this->release();
+        new (this) LineToken(std::move(other));
+    }
+    return *this;
+}
+
+LineToken::~LineToken() {
+    this->release();
+}
+
+void LineToken::release() {
+    if (this->length <= TOKEN_INLINE_CHARS) {
+        return;
+    }
+    if (this->text->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        this->text->~TokenText();
+        ::operator delete(this->text);
+    }
+    this->length = 0;
+}
+
+std::string_view LineToken::value() const {
+    if (this->length <= TOKEN_INLINE_CHARS) {
+        return std::string_view(this->chars, this->length);
+    }
+    return std::string_view(text_chars(this->text), this->length);
+}
+
+std::string_view LineToken::flag_prefix() const {
+    static const std::string dashes(255, '-');
+    return std::string_view(dashes).substr(0, this->flag_dashes);
+}
 
 bool LineToken::operator==(const LineToken& other) const {
     return this->kind == other.kind
-        && this->value == other.value
         && this->quote_mark == other.quote_mark
-        && this->flag_prefix == other.flag_prefix;
+        && this->flag_dashes == other.flag_dashes
+        && this->value() == other.value();
 }
 
 std::ostream& operator<<(std::ostream& os, const LineToken& token) {
@@ -26,9 +118,9 @@ std::ostream& operator<<(std::ostream& os, const LineToken& token) {
     } else {
         kind_str = "symbol";
     }
-    os << "{kind: " << kind_str << ", value=`" << token.value << "` ";
-    os << "quote_mark=`" << token.quote_mark << "` ";
-    os << "flag_prefix=`" << token.flag_prefix <<"` ";
+    os << "{kind: " << kind_str << ", value=`" << token.value() << "` ";
+    os << "quote_mark=`" << std::string_view(&token.quote_mark, token.quote_mark == 0 ? 0 : 1) << "` ";
+    os << "flag_prefix=`" << token.flag_prefix() <<"` ";
     os << "}";
     return os;
 }
@@ -51,35 +143,46 @@ std::ostream& operator<<(std::ostream& os, const Line& line) {
     return os;
 }
 
-LineToken generic_token(TokenKind kind, std::string value) {
-    return { .kind = kind, .value = value, .quote_mark = "", .flag_prefix = "" };
+LineToken generic_token(TokenKind kind, std::string_view value) {
+    return LineToken(kind, value);
+}
+
+LineToken word_token(std::string_view value) {
+    return LineToken(TokenKind::Word, value);
 }
 
-LineToken word_token(std::string value) {
-    return { .kind = TokenKind::Word, .value = value, .quote_mark = "", .flag_prefix = "" };
+LineToken symbol_token(std::string_view value) {
+    return LineToken(TokenKind::Symbol, value);
 }
 
-LineToken symbol_token(std::string value) {
-    return { .kind = TokenKind::Symbol, .value = value, .quote_mark = "", .flag_prefix = "" };
+LineToken whitespace_token(std::string_view value) {
+    return LineToken(TokenKind::Whitespace, value);
 }
 
-LineToken whitespace_token(std::string value) {
-    return { .kind = TokenKind::Whitespace, .value = value, .quote_mark = "", .flag_prefix = "" };
+LineToken quote_token(std::string_view value, std::string_view quote_mark) {
+    return LineToken(TokenKind::Quote, value, quote_mark.empty() ? 0 : quote_mark[0]);
 }
 
-LineToken quote_token(std::string value, std::string quote_mark) {
-    return { .kind = TokenKind::Quote, .value = value, .quote_mark = quote_mark, .flag_prefix = "" };
+// The prefix is only ever made of dashes.
+LineToken flag_token(std::string_view value, std::string_view prefix) {
+    return LineToken(TokenKind::Flag, value, 0, prefix.size());
 }
 
-LineToken flag_token(std::string value, std::string prefix) {
-    return { .kind = TokenKind::Flag, .value = value, .quote_mark = "", .flag_prefix = prefix };
+Line copy_line(const Line& line, std::pmr::memory_resource* resource) {
+    return {
+        .line_num = line.line_num,
+        .start = line.start,
+        .end = line.end,
+        .word_start = line.word_start,
+        .tokens = std::pmr::vector<LineToken>(line.tokens.begin(), line.tokens.end(), resource)
+    };
 }
 
-const std::string& Line::first_word() const {
+std::string_view Line::first_word() const {
     if (this->word_start == -1) {
-        return EMPTY_WORD;
+        return "";
     }
-    return this->tokens[this->word_start].value;
+    return this->tokens[this->word_start].value();
 }
 
 bool Line::only_whitespace() const {
@@ -95,8 +198,8 @@ bool Line::ends_with_symbol_seq(const std::string& symbol_seq) const {
 	}
 	const size_t length = symbol_seq.size();
 	for (size_t idx = 0; idx < length; idx++) {
-		const std::string c = std::string(1, symbol_seq[(length - 1) - idx]);
-		if (c != this->tokens[this->end - idx].value) {
+		const std::string_view c = std::string_view(symbol_seq).substr((length - 1) - idx, 1);
+		if (c != this->tokens[this->end - idx].value()) {
 			return false;
 		}
 	}
@@ -111,8 +214,8 @@ bool Line::has_symbol_seq(size_t index, const std::string& symbol_seq) const {
 		return false;
 	}
 	for (size_t idx = 0; idx < symbol_seq.size(); idx++)  {
-	    const std::string c = std::string(1, symbol_seq[idx]);
-		if (c != this->tokens[index + idx].value) {
+	    const std::string_view c = std::string_view(symbol_seq).substr(idx, 1);
+		if (c != this->tokens[index + idx].value()) {
 			return false;
 		}
 	}
@@ -127,7 +230,7 @@ bool Line::only_non_whitespace_equals(const std::string& value) const {
 	if (this->start == -1 || this->start != this->end) {
 		return false;
 	}
-	return this->tokens[this->start].value == value;
+	return this->tokens[this->start].value() == value;
 }
 
 bool Line::is_seq_of_strings(const std::vector<std::string>& values) const {
@@ -145,7 +248,7 @@ bool Line::is_seq_of_strings(const std::vector<std::string>& values) const {
 		if (this->tokens[i].kind == TokenKind::Whitespace) {
 			continue;
 		}
-		if (this->tokens[i].value != values[values_index]) {
+		if (this->tokens[i].value() != values[values_index]) {
 			return false;
 		}
 		values_index++;
@@ -156,62 +259,37 @@ bool Line::is_seq_of_strings(const std::vector<std::string>& values) const {
 std::string Line::raw() const {
     std::stringstream stream;
 	for (size_t idx = 0; idx < this->tokens.size(); idx++)  {
-		stream << this->tokens[idx].value;
+		stream << this->tokens[idx].value();
 	}
 	return stream.str();
 }
 
-Line Line::crop_from_first_word() const {
-    bool found_first_word = false;
-    int crop_offset = 0;
-    int start = -1;
-    int end = -1;
-    int word_start = -1;
-    std::vector<LineToken> new_tokens;
-    for (size_t idx = 0; idx < tokens.size(); idx++) {
-        const LineToken token = tokens[idx];
-        if (!found_first_word && token.kind != TokenKind::Word) {
-            continue;
-        }
-        if (!found_first_word && token.kind == TokenKind::Word) {
-            found_first_word = true;
-            crop_offset = idx + 1;
-            continue;
-        }
-        new_tokens.push_back(token);
-        if (token.kind != TokenKind::Whitespace) {
-            end = idx - crop_offset;
-        }
-        if (token.kind != TokenKind::Whitespace && start == -1) {
-            start = idx - crop_offset;
-        }
-        if (token.kind == TokenKind::Word && word_start == -1) {
-            word_start = idx - crop_offset;
-        }
+Line Line::crop_from_first_word(std::pmr::memory_resource* resource) const {
+    LineBuilder cropped(this->line_num, resource);
+    if (this->word_start == -1) {
+        return cropped.build();
     }
-    return {
-        .line_num = this->line_num,
-        .start = start,
-        .end = end,
-        .word_start = word_start,
-        .tokens = new_tokens
-    };
+    cropped.reserve(this->tokens.size() - this->word_start - 1);
+    for (size_t idx = this->word_start + 1; idx < this->tokens.size(); idx++) {
+        cropped.push(this->tokens[idx]);
+    }
+    return cropped.build();
 }
 
 bool Line::empty() const {
     return this->tokens.empty();
 }
 
-std::string Line::starting_whitespace() const {
+std::string_view Line::starting_whitespace() const {
     if (this->start == 0) {
         return "";
     }
-    return this->tokens[0].value;
+    return this->tokens[0].value();
 }
 
 void calculate_start_and_stops(Line& line) {
     for (size_t idx = 0; idx < line.tokens.size(); idx++) {
-        const LineToken token = line.tokens[idx];
+        const LineToken& token = line.tokens[idx];
         if (token.kind != TokenKind::Whitespace) {
             line.end = idx;
         }
@@ -224,123 +302,179 @@ void calculate_start_and_stops(Line& line) {
     }
 }
 
-Line Line::trim() const {
-    Line line = { .line_num = this->line_num, .start = -1, .end = -1, .word_start = -1, .tokens = {} };
+Line Line::trim(std::pmr::memory_resource* resource) const {
+    LineBuilder line(this->line_num, resource);
     const size_t start = this->tokens[0].kind == TokenKind::Whitespace
         ? 1
         : 0;
     const size_t end = this->tokens.back().kind == TokenKind::Whitespace
         ? this->tokens.size() - 1
         : this->tokens.size();
+    line.reserve(end > start ? end - start : 0);
     for (size_t idx = start; idx < end; idx++) {
-        line.tokens.push_back(this->tokens[idx]);
+        line.push(this->tokens[idx]);
     }
-    calculate_start_and_stops(line);
-    return line;
+    return line.build();
+}
+
+void Line::push(LineToken token) {
+    const int idx = this->tokens.size();
+    if (token.kind != TokenKind::Whitespace) {
+        this->end = idx;
+        if (this->start == -1) {
+            this->start = idx;
+        }
+    }
+    if (token.kind == TokenKind::Word && this->word_start == -1) {
+        this->word_start = idx;
+    }
+    this->tokens.push_back(std::move(token));
 }
 
 void Line::append(const Line& line) {
-    for (LineToken token : line.tokens) {
-        this->tokens.push_back(token);
+    this->tokens.reserve(this->tokens.size() + line.tokens.size());
+    for (const LineToken& token : line.tokens) {
+        this->push(token);
     }
-    calculate_start_and_stops(*this);
+}
+
+LineBuilder::LineBuilder(int line_num, std::pmr::memory_resource* resource) :
+    line({ .line_num = line_num, .start = -1, .end = -1, .word_start = -1, .tokens = std::pmr::vector<LineToken>(resource) }) {}
+
+void LineBuilder::reserve(size_t tokens) {
+    this->line.tokens.reserve(tokens);
+}
+
+void LineBuilder::push(LineToken token) {
+    this->line.push(std::move(token));
+}
+
+Line LineBuilder::build() {
+    return std::move(this->line);
 }
 
 TokenKind kind(char c) {
     if (c == '`') {
         return TokenKind::Word;
     }
-    if (std::isalpha(c) || std::isdigit(c) || c == '_') {
-        return TokenKind::Word;
-    }
-    if (std::isspace(c)) {
-        return TokenKind::Whitespace;
-    }
-    return TokenKind::Symbol;
+    return char_kind(c);
 }
 
 void Line::append(char value) {
-    this->tokens.push_back(generic_token(kind(value), std::string(1, value)));
-    calculate_start_and_stops(*this);
+    this->push(generic_token(kind(value), std::string_view(&value, 1)));
 }
 
 Line parse(int line_num, std::string value) {
-    LineToken* current = nullptr;
-    std::vector<LineToken> tokens;
-    bool in_backquotes = false;
-    for (size_t i = 0; i < value.length(); i++) {
-        const char c = value[i];
-        if (c == '`') {
-            in_backquotes = !in_backquotes;
-            continue;
-        }
-        const TokenKind char_kind = in_backquotes ? TokenKind::Word : kind(c);
-
-        if (current == nullptr || char_kind != current->kind) {
-            tokens.push_back(generic_token(char_kind, std::string(1, c)));
-            current = &tokens.back();
-            continue;
-        }
+    std::vector<TokenView> tokens;
+    lex_line(value, tokens);
+    return materialize(line_num, value, tokens.data(), tokens.size());
+}
 
-        if (char_kind == TokenKind::Symbol) {
-            tokens.push_back(symbol_token(std::string(1, c)));
-            current = nullptr;
-            continue;
-        }
+Line parse(int line_num, std::string_view text, const LexOptions& options) {
+    std::vector<TokenView> tokens;
+    lex_line(text, tokens, options);
+    return materialize(line_num, text, tokens.data(), tokens.size());
+}
 
-        current->value += std::string(1, c);
+std::vector<Line>& parse(
+    const std::vector<std::string>& lines_raw,
+    std::vector<Line>& lines,
+    std::pmr::memory_resource* resource,
+    size_t threads
+) {
+    if (threads == 0) {
+        threads = hardware_threads();
+    }
+    if (lines_raw.size() >= PARALLEL_PARSE_MIN_LINES && threads > 1) {
+        return parse_parallel(lines_raw, lines, threads, resource);
+    }
+    LexedSource lexed;
+    lex(lines_raw, lexed);
+    lines.reserve(lines.size() + lexed.lines.size());
+    for (size_t idx = 0; idx < lexed.lines.size(); idx++) {
+        lines.push_back(materialize(lexed, idx, resource));
     }
-    Line line = { .line_num = line_num, .start = -1, .end = -1, .word_start = -1, .tokens = tokens };
-    calculate_start_and_stops(line);
-    return line;
+    return lines;
 }
 
-std::vector<Line>& parse(const std::vector<std::string>& lines_raw, std::vector<Line>& lines) {
-    for(int i = 0; i < lines_raw.size(); i++) {
-        lines.push_back(parse(i + 1, lines_raw[i]));
+std::vector<Line>& parse_parallel(
+    const std::vector<std::string>& lines_raw,
+    std::vector<Line>& lines,
+    size_t threads,
+    std::pmr::memory_resource* resource
+) {
+    const size_t chunks = (lines_raw.size() + PARSE_CHUNK_LINES - 1) / PARSE_CHUNK_LINES;
+    std::vector<LexedSource> lexed(chunks);
+    ThreadPool pool = ThreadPool(std::max<size_t>(1, std::min(threads, chunks)));
+    pool.run(chunks, [&](size_t chunk) {
+        const size_t first = chunk * PARSE_CHUNK_LINES;
+        lex(lines_raw, first, std::min(first + PARSE_CHUNK_LINES, lines_raw.size()), lexed[chunk]);
+    });
+
+    const size_t first_line = lines.size();
+    lines.reserve(first_line + lines_raw.size());
+    for (const LexedSource& chunk : lexed) {
+        for (const LexedLine& line : chunk.lines) {
+            lines.push_back({
+                .line_num = line.line_num,
+                .start = -1,
+                .end = -1,
+                .word_start = -1,
+                .tokens = std::pmr::vector<LineToken>(resource)
+            });
+            lines.back().tokens.reserve(line.token_count);
+        }
     }
+
+    pool.run(chunks, [&](size_t chunk) {
+        const LexedSource& source = lexed[chunk];
+        Line* chunk_lines = lines.data() + first_line + chunk * PARSE_CHUNK_LINES;
+        for (size_t idx = 0; idx < source.lines.size(); idx++) {
+            const LexedLine& line = source.lines[idx];
+            materialize_into(chunk_lines[idx], line.text, source.tokens.data() + line.first_token, line.token_count);
+        }
+    });
     return lines;
 }
 
-
 Line parse_quotes(const Line& line) {
-    std::vector<LineToken> tokens = {};
+    LineBuilder quoted(line.line_num);
     std::string quote = "";
-    bool in_quotes;
+    bool in_quotes = false;
     char quote_char = 0;
     for (size_t idx = 0; idx < line.tokens.size(); idx++) {
-        const LineToken token = line.tokens[idx];
+        const LineToken& token = line.tokens[idx];
         if (token.kind != TokenKind::Symbol && in_quotes) {
-            quote += token.value;
+            quote += token.value();
             continue;
         }
 
         if (token.kind != TokenKind::Symbol) {
-            tokens.push_back(token);
+            quoted.push(token);
             continue;
         }
 
-        if (token.value == "\\") {
-            LineToken next_token = line.tokens[idx + 1];
-            if (next_token.kind == TokenKind::Symbol && next_token.value[0] == quote_char) {
+        if (token.value() == "\\" && idx + 1 < line.tokens.size()) {
+            const LineToken& next_token = line.tokens[idx + 1];
+            if (next_token.kind == TokenKind::Symbol && next_token.value()[0] == quote_char) {
                 quote += quote_char;
                 idx++;
                 continue;
             }
         }
 
-        if (token.value != "\"" && token.value != "'" && in_quotes) {
-            quote += token.value;
+        if (token.value() != "\"" && token.value() != "'" && in_quotes) {
+            quote += token.value();
             continue;
         }
 
-        if (token.value != "\"" && token.value != "'") {
-            tokens.push_back(token);
+        if (token.value() != "\"" && token.value() != "'") {
+            quoted.push(token);
             continue;
         }
 
         if (in_quotes) {
-            tokens.push_back(quote_token(quote, std::string(1, quote_char)));
+            quoted.push(quote_token(quote, std::string(1, quote_char)));
             quote_char = 0;
             in_quotes = false;
             quote = "";
@@ -348,41 +482,39 @@ Line parse_quotes(const Line& line) {
         }
 
         in_quotes = true;
-        quote_char = token.value[0];
+        quote_char = token.value()[0];
     }
-    Line quoted = { .line_num = line.line_num, .start = -1, .end = -1, .word_start = -1, .tokens = tokens };
-    calculate_start_and_stops(quoted);
-    return quoted;
+    return quoted.build();
 }
 
 Line parse_flags(const Line& line) {
-    std::vector<LineToken> tokens;
+    LineBuilder flagged(line.line_num);
     std::string flag = "";
     std::string flag_prefix = "";
     bool in_flag = false;
     bool found_first_flag_word = false;
     for (size_t idx = 0; idx < line.tokens.size(); idx++) {
-        const LineToken token = line.tokens[idx];
-        if (!in_flag && token.kind != TokenKind::Symbol && token.value != "-") {
-            tokens.push_back(token);
+        const LineToken& token = line.tokens[idx];
+        if (!in_flag && token.kind != TokenKind::Symbol && token.value() != "-") {
+            flagged.push(token);
             continue;
         }
 
-        if (!in_flag && token.kind == TokenKind::Symbol && token.value == "-") {
+        if (!in_flag && token.kind == TokenKind::Symbol && token.value() == "-") {
             in_flag = true;
-            flag_prefix = token.value;
+            flag_prefix = token.value();
             continue;
         }
 
         if (in_flag && token.kind == TokenKind::Whitespace) {
             if (!found_first_flag_word) {
                 for (char c : flag_prefix) {
-                    tokens.push_back(symbol_token(std::string(1, c)));
+                    flagged.push(symbol_token(std::string(1, c)));
                 }
-                tokens.push_back(token);
+                flagged.push(token);
             } else {
-                tokens.push_back(flag_token(flag, flag_prefix));
-                tokens.push_back(token);
+                flagged.push(flag_token(flag, flag_prefix));
+                flagged.push(token);
             }
             in_flag = false;
             flag = "";
@@ -391,48 +523,83 @@ Line parse_flags(const Line& line) {
             continue;
         }
 
-        if (in_flag && token.kind == TokenKind::Symbol && token.value == "-") {
+        if (in_flag && token.kind == TokenKind::Symbol && token.value() == "-") {
             if (found_first_flag_word) {
-                flag += token.value;
+                flag += token.value();
             } else {
-                flag_prefix += token.value;
+                flag_prefix += token.value();
             }
             continue;
         }
 
         if (in_flag && token.kind == TokenKind::Word) {
-            flag += token.value;
+            flag += token.value();
             found_first_flag_word = true;
             continue;
         }
     }
-    Line flagged = { .line_num = line.line_num, .start = -1, .end = -1, .word_start = -1, .tokens = tokens };
-    calculate_start_and_stops(flagged);
-    return flagged;
+    return flagged.build();
+}
+
+const uint64_t INDENTATION_HASH_SEED = 14695981039346656037ull;
+const uint64_t INDENTATION_HASH_PRIME = 1099511628211ull;
+
+uint64_t hash_indentation(std::string_view indentation) {
+    uint64_t hash = INDENTATION_HASH_SEED;
+    for (char c : indentation) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * INDENTATION_HASH_PRIME;
+    }
+    return hash;
+}
+
+IndentationLevel::IndentationLevel(std::string_view indentation) :
+    length(indentation.size()), hash(hash_indentation(indentation)) {}
+
+IndentationLevel::IndentationLevel(const char* indentation) :
+    IndentationLevel(std::string_view(indentation)) {}
+
+IndentationDiff Indentation::diff(std::string_view next_indentation) const {
+    return this->diff(IndentationLevel(next_indentation), next_indentation, this->indentations.size());
 }
 
-IndentationDiff Indentation::diff(const std::string& next_indentation) const {
-    if (this->indentations.empty()) {
-        return next_indentation.size() == 0
+// Levels grow strictly longer from the outermost one in, so the only level
+// a line can be the same as is the one of its length, and a line longer
+// than the innermost level increases it if it starts with that level.
+IndentationDiff Indentation::diff(const IndentationLevel& next_level, std::string_view next_indentation, size_t depth) const {
+    if (depth == 0) {
+        return next_level.length == 0
             ? IndentationDiff::Same
             : IndentationDiff::Increase;
     }
-    if (next_indentation == this->indentations.back()) {
-        return IndentationDiff::Same;
+    const IndentationLevel& last = this->indentations[depth - 1];
+    if (next_level.length > last.length) {
+        return hash_indentation(next_indentation.substr(0, last.length)) == last.hash
+            ? IndentationDiff::Increase
+            : IndentationDiff::Error;
     }
-    for (size_t idx = 0; idx < this->indentations.size(); idx++) {
-        if (this->indentations[idx] == next_indentation) {
-            return IndentationDiff::Decrease;
-        }
+    if (next_level == last) {
+        return IndentationDiff::Same;
     }
-    if (next_indentation.rfind(this->indentations.back(), 0) != 0) {
-        return IndentationDiff::Error;
+    const auto outer_end = this->indentations.begin() + (depth - 1);
+    const auto outer = std::lower_bound(
+        this->indentations.begin(),
+        outer_end,
+        next_level.length,
+        [](const IndentationLevel& level, uint32_t length) { return level.length < length; }
+    );
+    if (outer != outer_end && *outer == next_level) {
+        return IndentationDiff::Decrease;
     }
-    return IndentationDiff::Increase;
+    return IndentationDiff::Error;
 }
 
-Indentation Indentation::indent(const std::string& indentation) const {
-    std::vector<std::string> indentations = this->indentations;
-    indentations.push_back(indentation);
-    return { .indentations = indentations };
-}
\ No newline at end of file
+Indentation Indentation::indent(std::string_view indentation) const {
+    Indentation indented = *this;
+    indented.push(this->indentations.size(), indentation);
+    return indented;
+}
+
+void Indentation::push(size_t depth, const IndentationLevel& level) {
+    this->indentations.resize(depth, IndentationLevel(""));
+    this->indentations.push_back(level);
+}
@@ -2,10 +2,13 @@
 #define LK_LINE
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory_resource>
 #include <iostream>
+#include <cstdint>
 
-enum class TokenKind {
+enum class TokenKind : uint8_t {
     Whitespace,
     Word,
     Symbol,
@@ -13,11 +16,42 @@ enum class TokenKind {
     Flag
 };
 
-struct LineToken {
+// Longest value a LineToken stores in place.
+const size_t TOKEN_INLINE_CHARS = 8;
+
+struct TokenText;
+
+// A token of a line in 16 bytes. Values of up to TOKEN_INLINE_CHARS bytes,
+// which covers nearly all symbols, words and whitespace runs, are stored
+// in the token itself. Longer values live in a reference counted block
+// that copies of the token share.
+class LineToken {
+    public:
     TokenKind kind;
-    std::string value;
-    std::string quote_mark;
-    std::string flag_prefix;
+    // ' or " for a quote, 0 for every other kind.
+    char quote_mark;
+    // Dashes in front of a flag, at most 255.
+    uint8_t flag_dashes;
+
+    private:
+    uint32_t length;
+    union {
+        char chars[TOKEN_INLINE_CHARS];
+        TokenText* text;
+    };
+
+    void release();
+
+    public:
+    LineToken(TokenKind kind, std::string_view value, char quote_mark = 0, uint8_t flag_dashes = 0);
+    LineToken(const LineToken& other);
+    LineToken(LineToken&& other) noexcept;
+    LineToken& operator=(const LineToken& other);
+    LineToken& operator=(LineToken&& other) noexcept;
+    ~LineToken();
+
+    std::string_view value() const;
+    std::string_view flag_prefix() const;
 
     bool operator==(const LineToken& other) const;
     friend std::ostream& operator<<(std::ostream& os, const LineToken& token);
@@ -28,15 +62,15 @@ struct Line {
     int start;
     int end;
     int word_start;
-    std::vector<LineToken> tokens;
+    std::pmr::vector<LineToken> tokens;
 
     bool operator==(const Line& other) const;
     friend std::ostream& operator<<(std::ostream& os, const Line& line);
 
     std::string raw() const;
-    std::string starting_whitespace() const;
-    Line trim() const;
-    const std::string& first_word() const;
+    std::string_view starting_whitespace() const;
+    Line trim(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+    std::string_view first_word() const;
     bool only_whitespace() const;
     bool empty() const;
     bool ends_with_symbol_seq(const std::string& symbol_seq) const;
@@ -44,22 +78,68 @@ struct Line {
     bool starts_with_symbol_seq(const std::string& symbol_seq) const;
     bool only_non_whitespace_equals(const std::string& value) const;
     bool is_seq_of_strings(const std::vector<std::string>& values) const;
-    Line crop_from_first_word() const;
+    Line crop_from_first_word(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+    // Adds a token at the end, updating start, end and word_start for it
+    // alone rather than going over every token again.
+    void push(LineToken token);
     void append(const Line& line);
     void append(char str);
 };
 
-std::vector<Line>& parse(const std::vector<std::string>& lines_raw, std::vector<Line>& lines);
+// Builds a line token by token, starting from a line without tokens.
+class LineBuilder {
+    private:
+    Line line;
+
+    public:
+    LineBuilder(int line_num, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    void reserve(size_t tokens);
+    void push(LineToken token);
+    // Hands over the line, the builder is left without one.
+    Line build();
+};
+
+// Scripts with at least this many lines are parsed on up to the threads
+// given to parse().
+const size_t PARALLEL_PARSE_MIN_LINES = 8192;
+// Lines lexed and materialized by one pool task.
+const size_t PARSE_CHUNK_LINES = 1024;
+
+// Token storage for the parsed lines comes from resource, which must outlive them.
+// Large scripts are parsed on up to threads threads, 0 for every hardware
+// thread. Callers that already run parses on threads of their own pass 1.
+std::vector<Line>& parse(
+    const std::vector<std::string>& lines_raw,
+    std::vector<Line>& lines,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+    size_t threads = 0
+);
+// Same lines as parse, lexed and materialized in chunks on up to threads
+// threads. Token vectors are reserved from resource on the calling thread
+// before the chunks fill them, so resource need not be thread safe.
+std::vector<Line>& parse_parallel(
+    const std::vector<std::string>& lines_raw,
+    std::vector<Line>& lines,
+    size_t threads,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+);
 Line parse(int line_num, std::string value);
+// Sets start, end and word_start from the tokens of line, for lines whose
+// tokens were not added through Line::push.
+void calculate_start_and_stops(Line& line);
+// Copies line with its tokens allocated from resource. Plain copies of a
+// Line always allocate from the default resource.
+Line copy_line(const Line& line, std::pmr::memory_resource* resource);
 
 Line parse_quotes(const Line& line);
 Line parse_flags(const Line& line);
 
-LineToken word_token(std::string value);
-LineToken symbol_token(std::string value);
-LineToken whitespace_token(std::string value);
-LineToken quote_token(std::string value, std::string quote_mark);
-LineToken flag_token(std::string value, std::string prefix);
+LineToken word_token(std::string_view value);
+LineToken symbol_token(std::string_view value);
+LineToken whitespace_token(std::string_view value);
+LineToken quote_token(std::string_view value, std::string_view quote_mark);
+LineToken flag_token(std::string_view value, std::string_view prefix);
 
 enum class IndentationDiff {
     Increase,
@@ -68,12 +148,32 @@ enum class IndentationDiff {
     Error
 };
 
-struct Indentation {
-    std::vector<std::string> indentations;
+// A level of indentation kept as the length and hash of its whitespace,
+// so levels compare in constant time without holding on to the text.
+struct IndentationLevel {
+    uint32_t length;
+    uint64_t hash;
 
-    IndentationDiff diff(const std::string& next_indentation) const;
-    Indentation indent(const std::string& indentation) const;
+    IndentationLevel(std::string_view indentation);
+    IndentationLevel(const char* indentation);
+
+    bool operator==(const IndentationLevel& other) const = default;
+};
+
+// Levels of indentation of nested blocks, outermost first. Every level
+// extends the whitespace of the level before it, as the scanner only adds
+// a level for a line that diff() found to be an Increase.
+struct Indentation {
+    std::vector<IndentationLevel> indentations;
 
+    IndentationDiff diff(std::string_view next_indentation) const;
+    // Compares against the outermost depth levels only. next_level is the
+    // level of next_indentation, which a caller comparing one line against
+    // many depths only has to hash once.
+    IndentationDiff diff(const IndentationLevel& next_level, std::string_view next_indentation, size_t depth) const;
+    Indentation indent(std::string_view indentation) const;
+    // Drops the levels past depth and adds one after them.
+    void push(size_t depth, const IndentationLevel& level);
 };
 
 #endif
\ No newline at end of file
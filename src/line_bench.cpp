@@ -0,0 +1,210 @@
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "line.h"
+#include "lexer.h"
+
+int parse_bench = register_bench("Line/Parse/50k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(50000);
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        std::vector<Line> lines;
+        parse(script, lines);
+        keep(lines);
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/line", double(allocations() - allocs_before) / state.iterations / script.size());
+});
+
+// Heap bytes requested while parsing, per token: the token vectors, values
+// too long to be stored in place and the tables of the lexer.
+int token_bytes_bench = register_bench("Line/TokenBytes/50k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(50000);
+    size_t tokens = 0;
+    size_t bytes = 0;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        const size_t bytes_before = allocated_bytes();
+        std::vector<Line> lines;
+        lines.reserve(script.size());
+        const size_t lines_bytes = allocated_bytes() - bytes_before;
+        parse(script, lines);
+        bytes = allocated_bytes() - bytes_before - lines_bytes;
+        tokens = 0;
+        for (const Line& line : lines) {
+            tokens += line.tokens.size();
+        }
+        keep(lines);
+    }
+    state.items = tokens;
+    state.counter("bytes/token", double(bytes) / tokens);
+    state.counter("sizeof_token", sizeof(LineToken));
+});
+
+// Every character becomes a token of its own, appending should cost the
+// same per character however long the line already is.
+int append_chars_bench = register_bench("Line/AppendChars/100k", [](BenchState& state) {
+    const std::string text = generated_script(1)[0];
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        Line line = parse(1, "");
+        for (size_t idx = 0; idx < 100000; idx++) {
+            line.append(text[idx % text.size()]);
+        }
+        keep(line);
+    }
+    state.items = 100000;
+});
+
+// Quotes and flags found by two passes over every parsed line, against
+// the lexer finding them while it splits the line.
+int quotes_flags_passes_bench = register_bench("Line/QuotesAndFlags/50k/ThreePasses", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(50000);
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (const std::string& text : script) {
+            keep(parse_flags(parse_quotes(parse(1, text))));
+        }
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/line", double(allocations() - allocs_before) / state.iterations / script.size());
+});
+
+int quotes_flags_lexer_bench = register_bench("Line/QuotesAndFlags/50k/OnePass", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(50000);
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (const std::string& text : script) {
+            keep(parse(1, text, { .quotes = true, .flags = true }));
+        }
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/line", double(allocations() - allocs_before) / state.iterations / script.size());
+});
+
+// Time per line should drop with each thread up to the cores of the machine.
+void register_parse_parallel_bench(size_t threads) {
+    register_bench("Line/ParseParallel/200k/" + std::to_string(threads) + "threads", [threads](BenchState& state) {
+        const std::vector<std::string> script = generated_script(200000);
+
+        state.start();
+        for (size_t iter = 0; iter < state.iterations; iter++) {
+            std::pmr::monotonic_buffer_resource arena;
+            std::vector<Line> lines;
+            parse_parallel(script, lines, threads, &arena);
+            keep(lines);
+        }
+        state.bytes = script_bytes(script);
+        state.items = script.size();
+    });
+}
+
+int parse_parallel_benches = []() {
+    for (size_t threads : {1, 2, 4, 8, 16}) {
+        register_parse_parallel_bench(threads);
+    }
+    return 0;
+}();
+
+int lex_bench = register_bench("Lexer/Lex/50k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(50000);
+    LexedSource lexed;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        lexed.lines.clear();
+        lexed.tokens.clear();
+        lex(script, lexed);
+        keep(lexed);
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/line", double(allocations() - allocs_before) / state.iterations / script.size());
+});
+
+void lex_isa_bench(BenchState& state, CharClassIsa isa) {
+    const std::vector<std::string> script = generated_script(50000);
+    const RunEndFinder run_end = run_end_finder(isa);
+    std::vector<TokenView> tokens;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        tokens.clear();
+        for (const std::string& line : script) {
+            lex_line(line, tokens, run_end);
+        }
+        keep(tokens);
+    }
+    state.bytes = script_bytes(script);
+}
+
+int lex_scalar_bench = register_bench("Lexer/LexLines/50k/scalar", [](BenchState& state) {
+    lex_isa_bench(state, CharClassIsa::Scalar);
+});
+
+int lex_sse2_bench = register_bench("Lexer/LexLines/50k/sse2", [](BenchState& state) {
+    if (detected_isa() == CharClassIsa::Scalar) {
+        return;
+    }
+    lex_isa_bench(state, CharClassIsa::Sse2);
+});
+
+int lex_avx2_bench = register_bench("Lexer/LexLines/50k/avx2", [](BenchState& state) {
+    if (detected_isa() != CharClassIsa::Avx2) {
+        return;
+    }
+    lex_isa_bench(state, CharClassIsa::Avx2);
+});
+
+// Deeply indented lines with long identifiers, where runs span several
+// vector registers.
+std::vector<std::string> wide_script(size_t line_count) {
+    std::vector<std::string> lines;
+    for (size_t idx = 0; idx < line_count; idx++) {
+        lines.push_back(std::string(4 * (idx % 16), ' ') + "print_" + std::string(40, 'x') + "_" + std::to_string(idx) + " 'value'");
+    }
+    return lines;
+}
+
+void lex_wide_bench(BenchState& state, CharClassIsa isa) {
+    const std::vector<std::string> script = wide_script(50000);
+    const RunEndFinder run_end = run_end_finder(isa);
+    std::vector<TokenView> tokens;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        tokens.clear();
+        for (const std::string& line : script) {
+            lex_line(line, tokens, run_end);
+        }
+        keep(tokens);
+    }
+    state.bytes = script_bytes(script);
+}
+
+int lex_wide_scalar_bench = register_bench("Lexer/LexWideLines/50k/scalar", [](BenchState& state) {
+    lex_wide_bench(state, CharClassIsa::Scalar);
+});
+
+int lex_wide_sse2_bench = register_bench("Lexer/LexWideLines/50k/sse2", [](BenchState& state) {
+    if (detected_isa() == CharClassIsa::Scalar) {
+        return;
+    }
+    lex_wide_bench(state, CharClassIsa::Sse2);
+});
+
+int lex_wide_avx2_bench = register_bench("Lexer/LexWideLines/50k/avx2", [](BenchState& state) {
+    if (detected_isa() != CharClassIsa::Avx2) {
+        return;
+    }
+    lex_wide_bench(state, CharClassIsa::Avx2);
+});
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <optional>
 
 #include "line.h"
 
@@ -249,6 +250,24 @@ TEST(Indentation, WrongIndentation2) {
     EXPECT_EQ(indentation.diff(" \t "), IndentationDiff::Error);
 }
 
+TEST(Indentation, DiffAgainstOuterLevels) {
+    Indentation indentation = { .indentations = { "", "\t", "\t\t" } };
+    const IndentationLevel level("\t");
+    EXPECT_EQ(indentation.diff(level, "\t", 3), IndentationDiff::Decrease);
+    EXPECT_EQ(indentation.diff(level, "\t", 2), IndentationDiff::Same);
+    EXPECT_EQ(indentation.diff(level, "\t", 1), IndentationDiff::Increase);
+    EXPECT_EQ(indentation.diff(level, "\t", 0), IndentationDiff::Increase);
+}
+
+TEST(Indentation, PushDropsLevelsPastDepth) {
+    Indentation indentation = { .indentations = { "", "  ", "    " } };
+    indentation.push(1, "\t");
+    EXPECT_EQ(indentation.indentations.size(), 2);
+    EXPECT_EQ(indentation.diff("\t"), IndentationDiff::Same);
+    EXPECT_EQ(indentation.diff("  "), IndentationDiff::Error);
+    EXPECT_EQ(indentation.indent("\t ").diff("\t "), IndentationDiff::Same);
+}
+
 
 TEST(Line, parse_quotes_with_single_quote) {
     Line actual = parse_quotes(parse(1, "stdout 'Hello World'"));
@@ -491,4 +510,115 @@ TEST(Line, parse_flags_with_quoted_flag) {
     };
 
     EXPECT_EQ(actual, expected);
-}
\ No newline at end of file
+}
+std::vector<std::string> chunked_script() {
+    std::vector<std::string> lines;
+    for (size_t idx = 0; lines.size() < PARSE_CHUNK_LINES * 3 + 17; idx++) {
+        lines.push_back("print 'line " + std::to_string(idx) + "' --verbose");
+        lines.push_back("    `quoted word` \"" + std::to_string(idx) + "\"");
+        lines.push_back("");
+    }
+    return lines;
+}
+
+TEST(Line, parse_parallel_matches_parse) {
+    const std::vector<std::string> script = chunked_script();
+    std::vector<Line> expected;
+    parse(script, expected);
+
+    std::pmr::monotonic_buffer_resource arena;
+    std::vector<Line> actual;
+    parse_parallel(script, actual, 4, &arena);
+
+    EXPECT_EQ(actual, expected);
+}
+
+TEST(Line, parse_parallel_appends_to_lines) {
+    const std::vector<std::string> script = chunked_script();
+    std::vector<Line> expected = { parse(0, "first") };
+    parse(script, expected);
+
+    std::vector<Line> actual = { parse(0, "first") };
+    parse_parallel(script, actual, 3);
+
+    EXPECT_EQ(actual, expected);
+}
+
+TEST(Line, parse_threads_do_not_change_lines) {
+    std::vector<std::string> script;
+    while (script.size() < PARALLEL_PARSE_MIN_LINES) {
+        for (const std::string& line : chunked_script()) {
+            script.push_back(line);
+        }
+    }
+    std::vector<Line> one_thread;
+    parse(script, one_thread, std::pmr::get_default_resource(), 1);
+
+    std::vector<Line> threads;
+    parse(script, threads, std::pmr::get_default_resource(), 4);
+
+    EXPECT_EQ(threads, one_thread);
+}
+
+TEST(Line, token_stores_short_and_long_values) {
+    const std::string long_value = "a value too long to be stored in place";
+
+    EXPECT_EQ(word_token("print").value(), "print");
+    EXPECT_EQ(word_token("12345678").value(), "12345678");
+    EXPECT_EQ(quote_token(long_value, "'").value(), long_value);
+    EXPECT_EQ(quote_token(long_value, "'").quote_mark, '\'');
+    EXPECT_EQ(flag_token("verbose", "--").flag_prefix(), "--");
+    EXPECT_EQ(sizeof(LineToken), 16);
+}
+
+TEST(Line, token_copies_outlive_original) {
+    const std::string long_value = "a value too long to be stored in place";
+    std::optional<LineToken> original = quote_token(long_value, "\"");
+    LineToken copy = *original;
+    LineToken assigned = word_token("short");
+    assigned = copy;
+
+    original.reset();
+
+    EXPECT_EQ(copy, quote_token(long_value, "\""));
+    EXPECT_EQ(assigned.value(), long_value);
+}
+
+TEST(Line, token_can_be_reused_after_move) {
+    LineToken token = word_token("a_word_longer_than_eight");
+    LineToken moved = std::move(token);
+    token = word_token("reused");
+
+    EXPECT_EQ(moved.value(), "a_word_longer_than_eight");
+    EXPECT_EQ(token.value(), "reused");
+}
+
+TEST(Line, push_tracks_start_and_end) {
+    const Line parsed = parse(3, "\t\tprint 'a b' --verbose  ");
+    LineBuilder builder(3);
+    for (const LineToken& token : parsed.tokens) {
+        builder.push(token);
+    }
+    const Line built = builder.build();
+
+    Line recalculated = built;
+    calculate_start_and_stops(recalculated);
+    EXPECT_EQ(built, parsed);
+    EXPECT_EQ(built.start, recalculated.start);
+    EXPECT_EQ(built.end, recalculated.end);
+    EXPECT_EQ(built.word_start, recalculated.word_start);
+}
+
+TEST(Line, append_char_tracks_start_and_end) {
+    const std::string text = "  if x  ";
+    Line line = { .line_num = 0, .start = -1, .end = -1, .word_start = -1, .tokens = {} };
+    for (char c : text) {
+        line.append(c);
+        Line recalculated = line;
+        calculate_start_and_stops(recalculated);
+        EXPECT_EQ(line.start, recalculated.start);
+        EXPECT_EQ(line.end, recalculated.end);
+        EXPECT_EQ(line.word_start, recalculated.word_start);
+    }
+    EXPECT_EQ(line.tokens.size(), text.size());
+}
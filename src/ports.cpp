@@ -1,25 +1,262 @@
 
 #include <string>
 #include <vector>
+#include <cstring>
 #include <filesystem>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include "ports.h"
 
 namespace fs = std::filesystem;
 
+const size_t DIRENT_BUFFER_SIZE = 32 * 1024;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+enum class EntryKind {
+    Other,
+    File,
+    Executable
+};
+
+// The d_type from getdents64 already rules out directories, devices and the
+// like. Only regular files, symlinks and filesystems that do not report a
+// type need a stat, and that one fstatat answers both type and mode.
+EntryKind entry_kind(int dir_fd, const linux_dirent64* entry) {
+    if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+        return EntryKind::Other;
+    }
+    struct stat info;
+    if (::fstatat(dir_fd, entry->d_name, &info, 0) != 0 || !S_ISREG(info.st_mode)) {
+        return EntryKind::Other;
+    }
+    return (info.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0
+        ? EntryKind::Executable
+        : EntryKind::File;
+}
+
+template <typename Visit>
+void read_dir(const std::string& path, Visit visit) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    alignas(linux_dirent64) char buffer[DIRENT_BUFFER_SIZE];
+    while (true) {
+        const long read = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (read <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < read;) {
+            const linux_dirent64* entry = reinterpret_cast<const linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+            if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            visit(fd, entry);
+        }
+    }
+    ::close(fd);
+}
+
+void DirListing::clear() {
+    this->names.clear();
+    this->ends.clear();
+}
+
+void DirListing::add(std::string_view name) {
+    this->names.append(name);
+    this->ends.push_back(this->names.size());
+}
+
+size_t DirListing::size() const {
+    return this->ends.size();
+}
+
+std::string_view DirListing::name(size_t idx) const {
+    const size_t start = idx == 0 ? 0 : this->ends[idx - 1];
+    return std::string_view(this->names).substr(start, this->ends[idx] - start);
+}
+
+void Disk::ls_executables(const std::string& path, DirListing& listing) {
+    listing.clear();
+    for (const File& file : this->ls(path)) {
+        if (file.can_execute) {
+            listing.add(file.name);
+        }
+    }
+}
+
 std::vector<File> FileSystemDisk::ls(const std::string& path) {
     std::vector<File> files;
-    for (const fs::directory_entry& entry : fs::directory_iterator(path)) {
-        if (!entry.is_regular_file()) {
-            continue;
+    read_dir(path, [&](int dir_fd, const linux_dirent64* entry) {
+        const EntryKind kind = entry_kind(dir_fd, entry);
+        if (kind == EntryKind::Other) {
+            return;
         }
-        const fs::perms perms = fs::status(entry.path()).permissions();
-        const bool exec_perm = (perms & fs::perms::owner_exec) != fs::perms::owner_exec;
-        files.push_back({ .path = "", .name = entry.path().filename(), .can_execute = exec_perm });
-    }
+        files.push_back({ .path = path + "/" + entry->d_name, .name = entry->d_name, .can_execute = kind == EntryKind::Executable });
+    });
     return files;
 }
 
+void FileSystemDisk::ls_executables(const std::string& path, DirListing& listing) {
+    listing.clear();
+    read_dir(path, [&](int dir_fd, const linux_dirent64* entry) {
+        if (entry_kind(dir_fd, entry) == EntryKind::Executable) {
+            listing.add(entry->d_name);
+        }
+    });
+}
+
+bool DirStamp::operator==(const DirStamp& other) const {
+    return this->inode == other.inode
+        && this->mtime_ns == other.mtime_ns;
+}
+
+std::optional<DirStamp> Disk::stamp(const std::string&) {
+    return std::nullopt;
+}
+
+std::optional<DirStamp> FileSystemDisk::stamp(const std::string& path) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return DirStamp{ .inode = 0, .mtime_ns = 0 };
+    }
+    return DirStamp{
+        .inode = info.st_ino,
+        .mtime_ns = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec
+    };
+}
+
+std::optional<File> Disk::find(const std::string& dir, const std::string& name) {
+    for (const File& file : this->ls(dir)) {
+        if (file.name == name && file.can_execute) {
+            return file;
+        }
+    }
+    return std::nullopt;
+}
+
+FileSystemDisk::~FileSystemDisk() {
+    for (const auto& [dir, fd] : this->dir_fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+// Directories are opened once and kept open, so every later probe is a
+// single fstatat relative to the directory instead of a full path walk.
+int FileSystemDisk::dir_fd(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(this->dirs_mutex);
+    const auto found = this->dir_fds.find(dir);
+    if (found != this->dir_fds.end()) {
+        return found->second;
+    }
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    this->dir_fds.emplace(dir, fd);
+    return fd;
+}
+
+std::optional<File> FileSystemDisk::find(const std::string& dir, const std::string& name) {
+    if (name.empty() || name.find('/') != std::string::npos) {
+        return std::nullopt;
+    }
+    const int fd = this->dir_fd(dir);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat info;
+    if (::fstatat(fd, name.c_str(), &info, 0) != 0) {
+        return std::nullopt;
+    }
+    if (!S_ISREG(info.st_mode) || (info.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) == 0) {
+        return std::nullopt;
+    }
+    return File{ .path = dir + "/" + name, .name = name, .can_execute = true };
+}
 
 std::string ShellEnv::var(const std::string& name) {
-    return std::getenv(name.c_str());
-}
\ No newline at end of file
+    const char* value = std::getenv(name.c_str());
+    return value == nullptr ? "" : value;
+}
+
+std::optional<std::string> cache_dir(Env& env) {
+    const std::string xdg_cache = env.var("XDG_CACHE_HOME");
+    if (!xdg_cache.empty()) {
+        return xdg_cache + "/lorikeet";
+    }
+    const std::string home = env.var("HOME");
+    if (!home.empty()) {
+        return home + "/.cache/lorikeet";
+    }
+    return std::nullopt;
+}
+
+bool make_private_dir(const std::string& dir) {
+    std::error_code err;
+    const fs::path parent = fs::path(dir).parent_path();
+    if (!parent.empty()) {
+        fs::create_directories(parent, err);
+    }
+    ::mkdir(dir.c_str(), 0700);
+    struct stat info;
+    if (::lstat(dir.c_str(), &info) != 0) {
+        return false;
+    }
+    return S_ISDIR(info.st_mode) && info.st_uid == ::geteuid();
+}
+
+MappedFile::MappedFile(const std::string& path) :
+    mapped_data(nullptr),
+    mapped_size(0),
+    is_open(false),
+    is_owned(false) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        this->is_open = true;
+        this->is_owned = info.st_uid == ::geteuid();
+        if (info.st_size > 0) {
+            void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                this->is_open = false;
+            } else {
+                this->mapped_data = static_cast<const char*>(mapped);
+                this->mapped_size = info.st_size;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (this->mapped_data != nullptr) {
+        ::munmap(const_cast<char*>(this->mapped_data), this->mapped_size);
+    }
+}
+
+bool MappedFile::open() const {
+    return this->is_open;
+}
+
+bool MappedFile::owned_by_user() const {
+    return this->is_owned;
+}
+
+std::string_view MappedFile::data() const {
+    return std::string_view(this->mapped_data, this->mapped_size);
+}
@@ -3,6 +3,11 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <optional>
+#include <mutex>
+#include <unordered_map>
 
 struct File {
     std::string path;
@@ -10,14 +15,54 @@ struct File {
     bool can_execute;
 };
 
+// Names of the executables in a directory, packed back to back in one
+// buffer. Clearing keeps the capacity, so one listing can be reused for
+// many directories without allocating per name.
+struct DirListing {
+    std::string names;
+    std::vector<uint32_t> ends;
+
+    void clear();
+    void add(std::string_view name);
+    size_t size() const;
+    std::string_view name(size_t idx) const;
+};
+
+// Identifies the state of a directory's listing. A directory that does not
+// exist has a zero stamp, so creating it later still invalidates a cache.
+struct DirStamp {
+    uint64_t inode;
+    int64_t mtime_ns;
+
+    bool operator==(const DirStamp& other) const;
+};
+
+// Implementations must allow ls to be called from several threads at once.
 class Disk {
     public:
     virtual std::vector<File> ls(const std::string& path) = 0;
+    // Replaces the contents of listing with the executables in path.
+    virtual void ls_executables(const std::string& path, DirListing& listing);
+    // Disks that can not stamp directories return nullopt, which disables caching.
+    virtual std::optional<DirStamp> stamp(const std::string& path);
+    // Looks up a single executable in a directory without listing all of it.
+    virtual std::optional<File> find(const std::string& dir, const std::string& name);
 };
 
 class FileSystemDisk: public Disk {
+    private:
+    std::mutex dirs_mutex;
+    std::unordered_map<std::string, int> dir_fds;
+
+    int dir_fd(const std::string& dir);
+
     public:
+    ~FileSystemDisk();
+
     std::vector<File> ls(const std::string& path);
+    void ls_executables(const std::string& path, DirListing& listing);
+    std::optional<DirStamp> stamp(const std::string& path);
+    std::optional<File> find(const std::string& dir, const std::string& name);
 };
 
 class Env {
@@ -30,4 +75,33 @@ class ShellEnv: public Env {
     std::string var(const std::string& name);
 };
 
+// Per user cache directory, nullopt when the environment names no home to
+// keep one in, which disables caching rather than falling back to a shared
+// directory that other users could plant files in.
+std::optional<std::string> cache_dir(Env& env);
+// Creates dir and its parents, dir itself only readable by its owner.
+// False when dir can not be created or belongs to another user.
+bool make_private_dir(const std::string& dir);
+
+// Read only mapping of a whole file, unmapped when it goes out of scope.
+// An empty file is opened but has no data.
+class MappedFile {
+    private:
+    const char* mapped_data;
+    size_t mapped_size;
+    bool is_open;
+    bool is_owned;
+
+    public:
+    MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open() const;
+    // Caches only trust files written by the user running the process.
+    bool owned_by_user() const;
+    std::string_view data() const;
+};
+
 #endif
\ No newline at end of file
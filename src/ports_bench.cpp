@@ -0,0 +1,77 @@
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+#include "bench.h"
+#include "ports.h"
+
+namespace fs = std::filesystem;
+
+const size_t LS_BENCH_FILES = 2000;
+
+const std::string& ls_bench_dir() {
+    static const std::string dir = []() {
+        const fs::path bin = fs::temp_directory_path() / "lorikeet_bench_ls";
+        fs::create_directories(bin);
+        for (size_t idx = 0; idx < LS_BENCH_FILES; idx++) {
+            const fs::path file = bin / ("tool" + std::to_string(idx));
+            if (!fs::exists(file)) {
+                std::ofstream(file) << "#!/bin/sh\n";
+                fs::permissions(file, idx % 4 == 0 ? fs::perms::owner_read : fs::perms::owner_all);
+            }
+        }
+        return bin.string();
+    }();
+    return dir;
+}
+
+int ls_bench = register_bench("Disk/Ls/2000files", [](BenchState& state) {
+    const std::string& dir = ls_bench_dir();
+    FileSystemDisk disk;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(disk.ls(dir));
+    }
+    state.items = LS_BENCH_FILES;
+    state.counter("allocs/dir", double(allocations() - allocs_before) / state.iterations);
+});
+
+int ls_executables_bench = register_bench("Disk/LsExecutables/2000files", [](BenchState& state) {
+    const std::string& dir = ls_bench_dir();
+    FileSystemDisk disk;
+    DirListing listing;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        disk.ls_executables(dir, listing);
+        keep(listing);
+    }
+    state.items = LS_BENCH_FILES;
+    state.counter("allocs/dir", double(allocations() - allocs_before) / state.iterations);
+});
+
+// What FileSystemDisk::ls did before it read the directory with getdents64:
+// a directory_iterator plus a separate status call per entry.
+int directory_iterator_bench = register_bench("Disk/DirectoryIterator/2000files", [](BenchState& state) {
+    const std::string& dir = ls_bench_dir();
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        std::vector<File> files;
+        for (const fs::directory_entry& entry : fs::directory_iterator(dir)) {
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            const fs::perms perms = fs::status(entry.path()).permissions();
+            const bool exec_perm = (perms & fs::perms::owner_exec) == fs::perms::owner_exec;
+            files.push_back({ .path = "", .name = entry.path().filename(), .can_execute = exec_perm });
+        }
+        keep(files);
+    }
+    state.items = LS_BENCH_FILES;
+    state.counter("allocs/dir", double(allocations() - allocs_before) / state.iterations);
+});
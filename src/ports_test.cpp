@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+#include "ports.h"
+
+namespace fs = std::filesystem;
+
+fs::path test_bin_dir() {
+    const fs::path dir = fs::temp_directory_path() / "lorikeet_test" / "bin";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "subdir");
+    std::ofstream(dir / "tool") << "#!/bin/sh\n";
+    fs::permissions(dir / "tool", fs::perms::owner_all);
+    std::ofstream(dir / "notes.txt") << "text\n";
+    fs::permissions(dir / "notes.txt", fs::perms::owner_read | fs::perms::owner_write);
+    fs::create_symlink(dir / "tool", dir / "tool-link");
+    fs::create_symlink(dir / "missing", dir / "broken-link");
+    return dir;
+}
+
+std::vector<std::string> sorted_names(const DirListing& listing) {
+    std::vector<std::string> names;
+    for (size_t idx = 0; idx < listing.size(); idx++) {
+        names.push_back(std::string(listing.name(idx)));
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+TEST(FileSystemDisk, ListsOnlyExecutables) {
+    const fs::path dir = test_bin_dir();
+    FileSystemDisk disk;
+    DirListing listing;
+
+    disk.ls_executables(dir, listing);
+
+    EXPECT_EQ(sorted_names(listing), std::vector<std::string>({"tool", "tool-link"}));
+}
+
+TEST(FileSystemDisk, ListingIsReplacedOnReuse) {
+    const fs::path dir = test_bin_dir();
+    FileSystemDisk disk;
+    DirListing listing;
+    listing.add("stale");
+
+    disk.ls_executables(dir, listing);
+    disk.ls_executables(dir, listing);
+
+    EXPECT_EQ(sorted_names(listing), std::vector<std::string>({"tool", "tool-link"}));
+}
+
+TEST(FileSystemDisk, ListsRegularFilesWithExecuteFlag) {
+    const fs::path dir = test_bin_dir();
+    FileSystemDisk disk;
+
+    std::vector<File> files = disk.ls(dir);
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.name < b.name; });
+
+    ASSERT_EQ(files.size(), 3);
+    EXPECT_EQ(files[0].name, "notes.txt");
+    EXPECT_FALSE(files[0].can_execute);
+    EXPECT_EQ(files[1].name, "tool");
+    EXPECT_EQ(files[1].path, (dir / "tool").string());
+    EXPECT_TRUE(files[1].can_execute);
+    EXPECT_EQ(files[2].name, "tool-link");
+    EXPECT_TRUE(files[2].can_execute);
+}
+
+TEST(FileSystemDisk, MissingDirectoryIsEmpty) {
+    FileSystemDisk disk;
+    DirListing listing;
+
+    disk.ls_executables("/does/not/exist", listing);
+
+    EXPECT_EQ(listing.size(), 0);
+    EXPECT_TRUE(disk.ls("/does/not/exist").empty());
+}
+
+TEST(FileSystemDisk, FindsSingleExecutable) {
+    const fs::path dir = test_bin_dir();
+    FileSystemDisk disk;
+
+    EXPECT_EQ(disk.find(dir, "tool").value().path, (dir / "tool").string());
+    EXPECT_EQ(disk.find(dir, "notes.txt"), std::nullopt);
+    EXPECT_EQ(disk.find(dir, "subdir"), std::nullopt);
+}
@@ -1,15 +1,58 @@
 
 
+#include <algorithm>
+
 #include "state_machine.h"
+#include "thread_pool.h"
+#include "hash.h"
 
 std::vector<std::string> split_paths(std::string path);
+uint64_t commands_fingerprint(const std::vector<CommandInstr>& command_instrs);
 
 
 void RootStateMachine::init() {
-    std::vector<std::string> paths = split_paths(this->env.var("PATH"));
+    this->init(hardware_threads());
+}
+
+void RootStateMachine::init(size_t scan_threads) {
+    const std::string path_var = this->env.var("PATH");
+    std::vector<std::string> paths = split_paths(path_var);
+    const std::optional<CommandCacheKey> key = this->cache_key(path_var, paths);
+    if (key.has_value()) {
+        std::optional<std::vector<CommandInstr>> cached = this->cache->load(key.value());
+        if (cached.has_value()) {
+            for (const CommandInstr& instr : cached.value()) {
+                this->add_cmd_instr(instr);
+            }
+            this->table_fingerprint = commands_fingerprint(this->command_instrs);
+            return;
+        }
+    }
+    this->load_cmd_instrs(paths, scan_threads);
+    if (key.has_value()) {
+        this->cache->store(key.value(), this->command_instrs);
+    }
+    this->table_fingerprint = commands_fingerprint(this->command_instrs);
+}
+
+void RootStateMachine::init_lazy() {
+    this->lazy = true;
+    this->lazy_paths = split_paths(this->env.var("PATH"));
+}
+
+std::optional<CommandCacheKey> RootStateMachine::cache_key(const std::string& path_var, const std::vector<std::string>& paths) {
+    if (this->cache == nullptr) {
+        return std::nullopt;
+    }
+    CommandCacheKey key = { .path_var = path_var, .stamps = {} };
     for (const std::string& path : paths) {
-        this->load_cmd_instrs(path);
+        const std::optional<DirStamp> stamp = this->disk.stamp(path);
+        if (!stamp.has_value()) {
+            return std::nullopt;
+        }
+        key.stamps.push_back(stamp.value());
     }
+    return key;
 }
 
 std::vector<std::string> split_paths(std::string path) {
@@ -22,36 +65,191 @@ std::vector<std::string> split_paths(std::string path) {
     return paths;
 }
 
-void RootStateMachine::load_cmd_instrs(const std::string& path) {
-    for (File file : this->disk.ls(path)) {
-        if (file.can_execute) {
-            this->command_instrs.push_back({ .id = this->id_gen.new_instr_id(), .name = file.name, .path = file.path });
+void RootStateMachine::load_cmd_instrs(const std::vector<std::string>& paths, size_t scan_threads) {
+    std::vector<DirListing> listings(paths.size());
+    ThreadPool pool = ThreadPool(std::max<size_t>(1, std::min(scan_threads, paths.size())));
+    pool.run(paths.size(), [&](size_t idx) {
+        this->disk.ls_executables(paths[idx], listings[idx]);
+    });
+    for (size_t dir = 0; dir < paths.size(); dir++) {
+        const DirListing& listing = listings[dir];
+        for (size_t idx = 0; idx < listing.size(); idx++) {
+            const std::string name = std::string(listing.name(idx));
+            this->add_cmd_instr({ .id = this->id_gen.new_instr_id(), .name = name, .path = paths[dir] + "/" + name });
         }
     }
 }
 
+// Directories are loaded in PATH order, so the first command registered under
+// a name is the one a shell would run; later ones stay in the table but are
+// shadowed in the name index.
+void RootStateMachine::add_cmd_instr(const CommandInstr& instr) {
+    const size_t index = this->command_instrs.size();
+    this->command_instrs.push_back(instr);
+    this->name_index.emplace(instr.name, index);
+    this->id_index.emplace(instr.id, index);
+}
+
+uint64_t commands_fingerprint(const std::vector<CommandInstr>& command_instrs) {
+    uint64_t hash = content_hash(command_instrs.size(), 0);
+    for (const CommandInstr& instr : command_instrs) {
+        hash = content_hash(instr.id, hash);
+        hash = content_hash(instr.name, hash);
+        hash = content_hash(instr.path, hash);
+    }
+    return hash;
+}
+
+// A lazy machine only knows the commands looked up so far, which says
+// nothing about what the next lookup resolves to. An eager machine takes
+// its fingerprint at the end of init(), so threads sharing it only read.
+std::optional<uint64_t> RootStateMachine::fingerprint() {
+    if (this->lazy) {
+        return std::nullopt;
+    }
+    if (!this->table_fingerprint.has_value()) {
+        return commands_fingerprint(this->command_instrs);
+    }
+    return this->table_fingerprint;
+}
+
+// Lazy lookups register the commands they resolve, and hand out ids in the
+// order names are first looked up.
+bool RootStateMachine::concurrent_lookups() {
+    return !this->lazy;
+}
+
 TaxStrat RootStateMachine::tax_strat(InstructionID instr) {
-    for (const CommandInstr& cmd_instr : this->command_instrs) {
-        if (cmd_instr.id == instr) {
-            return command_strat();
-        }
+    if (this->id_index.find(instr) != this->id_index.end()) {
+        return command_strat();
     }
     return value_strat();
 }
 
 std::optional<InstructionID> RootStateMachine::find_instr(const std::string& name) {
-    const std::optional<CommandInstr> cmd_opt = this->get_cmd_instr(name);
-    if (cmd_opt.has_value()) {
-        return cmd_opt.value().id;
+    const std::optional<size_t> index = this->cmd_instr_index(name);
+    if (!index.has_value()) {
+        return std::nullopt;
     }
-    return std::nullopt;
+    return this->command_instrs[index.value()].id;
 }
 
 std::optional<CommandInstr> RootStateMachine::get_cmd_instr(const std::string& instr_name) {
-    for (const CommandInstr& instr : this->command_instrs) {
-        if (instr.name == instr_name) {
-            return instr;
+    const std::optional<size_t> index = this->cmd_instr_index(instr_name);
+    if (!index.has_value()) {
+        return std::nullopt;
+    }
+    return this->command_instrs[index.value()];
+}
+
+std::optional<size_t> RootStateMachine::cmd_instr_index(const std::string& name) {
+    const auto found = this->name_index.find(name);
+    if (found != this->name_index.end()) {
+        return found->second;
+    }
+    if (this->lazy) {
+        return this->resolve_cmd_instr(name);
+    }
+    return std::nullopt;
+}
+
+// Misses are remembered as well as hits, a script that uses a name which is
+// not on PATH only pays for probing the PATH directories once.
+std::optional<size_t> RootStateMachine::resolve_cmd_instr(const std::string& name) {
+    if (this->lazy_misses.find(name) != this->lazy_misses.end()) {
+        return std::nullopt;
+    }
+    for (const std::string& path : this->lazy_paths) {
+        const std::optional<File> file = this->disk.find(path, name);
+        if (file.has_value()) {
+            this->add_cmd_instr({ .id = this->id_gen.new_instr_id(), .name = file.value().name, .path = file.value().path });
+            return this->command_instrs.size() - 1;
         }
     }
+    this->lazy_misses.insert(name);
     return std::nullopt;
-}
\ No newline at end of file
+}
+
+FrozenStateMachine RootStateMachine::freeze() const {
+    return FrozenStateMachine(std::make_shared<const InstructionTable>(this->command_instrs));
+}
+
+InstructionTable::InstructionTable(std::vector<CommandInstr> command_instrs) :
+    command_instrs(std::move(command_instrs)),
+    table_fingerprint(commands_fingerprint(this->command_instrs)) {
+    this->names.reserve(this->command_instrs.size());
+    this->name_index.reserve(this->command_instrs.size());
+    this->id_index.reserve(this->command_instrs.size());
+    for (size_t index = 0; index < this->command_instrs.size(); index++) {
+        this->names.push_back(Symbol(this->command_instrs[index].name));
+        this->name_index.emplace(this->command_instrs[index].name, index);
+        this->id_index.emplace(this->command_instrs[index].id, index);
+    }
+}
+
+std::optional<size_t> InstructionTable::cmd_instr_index(std::string_view name) const {
+    const auto found = this->name_index.find(name);
+    if (found == this->name_index.end()) {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+std::optional<CommandInstr> InstructionTable::get_cmd_instr(const std::string& name) const {
+    const std::optional<size_t> index = this->cmd_instr_index(name);
+    if (!index.has_value()) {
+        return std::nullopt;
+    }
+    return this->command_instrs[index.value()];
+}
+
+std::optional<InstructionID> InstructionTable::find_instr(std::string_view name) const {
+    const std::optional<size_t> index = this->cmd_instr_index(name);
+    if (!index.has_value()) {
+        return std::nullopt;
+    }
+    return this->command_instrs[index.value()].id;
+}
+
+std::optional<NamedInstruction> InstructionTable::find_named_instr(std::string_view name) const {
+    const std::optional<size_t> index = this->cmd_instr_index(name);
+    if (!index.has_value()) {
+        return std::nullopt;
+    }
+    return NamedInstruction{ .id = this->command_instrs[index.value()].id, .name = this->names[index.value()] };
+}
+
+TaxStrat InstructionTable::tax_strat(InstructionID instr) const {
+    if (this->id_index.find(instr) != this->id_index.end()) {
+        return command_strat();
+    }
+    return value_strat();
+}
+
+uint64_t InstructionTable::fingerprint() const {
+    return this->table_fingerprint;
+}
+
+size_t InstructionTable::size() const {
+    return this->command_instrs.size();
+}
+
+const InstructionTable& FrozenStateMachine::instructions() const {
+    return *this->table;
+}
+
+std::optional<InstructionID> FrozenStateMachine::find_instr(const std::string& name) {
+    return this->table->find_instr(name);
+}
+
+TaxStrat FrozenStateMachine::tax_strat(InstructionID instr) {
+    return this->table->tax_strat(instr);
+}
+
+std::optional<uint64_t> FrozenStateMachine::fingerprint() {
+    return this->table->fingerprint();
+}
+
+bool FrozenStateMachine::concurrent_lookups() {
+    return true;
+}
@@ -4,16 +4,107 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 
 #include "ports.h"
 #include "core_types.h"
 #include "cmd_instr.h"
+#include "cmd_cache.h"
 
 class StateMachine {
     public:
     virtual std::optional<InstructionID> find_instr(const std::string& name) = 0;
     virtual TaxStrat tax_strat(InstructionID instr) = 0;
+    // Identifies every instruction and id the machine resolves, so that a
+    // scan made against it can be reused. Machines that can not enumerate
+    // their instructions have none.
+    virtual std::optional<uint64_t> fingerprint() {
+        return std::nullopt;
+    }
+    // Whether find_instr and tax_strat may be called from several threads
+    // at once, which lets large scripts be scanned in parallel.
+    virtual bool concurrent_lookups() {
+        return false;
+    }
+};
+
+// Hashes std::string keys and std::string_view lookups alike, so maps keyed
+// by name can be searched with a view without building a string.
+struct NameHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>()(name);
+    }
+};
+
+// An instruction found by name, along with the interned name.
+struct NamedInstruction {
+    InstructionID id;
+    Symbol name;
+};
+
+// Commands of a machine at the moment it was frozen. Nothing changes after
+// construction, so every lookup is const and any number of threads may
+// look up at once without locking.
+class InstructionTable {
+    private:
+    std::vector<CommandInstr> command_instrs;
+    // Names of command_instrs, interned when the table is built.
+    std::vector<Symbol> names;
+    std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> name_index;
+    std::unordered_map<InstructionID, size_t> id_index;
+    uint64_t table_fingerprint;
+
+    std::optional<size_t> cmd_instr_index(std::string_view name) const;
+
+    public:
+    // Earlier commands shadow later ones of the same name, as on PATH.
+    InstructionTable(std::vector<CommandInstr> command_instrs);
+
+    std::optional<CommandInstr> get_cmd_instr(const std::string& name) const;
+    std::optional<InstructionID> find_instr(std::string_view name) const;
+    std::optional<NamedInstruction> find_named_instr(std::string_view name) const;
+    TaxStrat tax_strat(InstructionID instr) const;
+    uint64_t fingerprint() const;
+    size_t size() const;
+};
+
+// StateMachine over a shared InstructionTable. Copies share the table and
+// lookups never change the machine, so one frozen machine can be scanned
+// against from any number of threads. The const lookups are not virtual,
+// code that knows it holds a frozen machine calls them directly.
+class FrozenStateMachine final: public StateMachine {
+    private:
+    std::shared_ptr<const InstructionTable> table;
+
+    public:
+    FrozenStateMachine(std::shared_ptr<const InstructionTable> table) : table(std::move(table)) {}
+
+    const InstructionTable& instructions() const;
+    std::optional<InstructionID> find_instr(const std::string& name);
+    std::optional<InstructionID> find_instr(std::string_view name) const {
+        return this->table->find_instr(name);
+    }
+    // Scans name their statements with the symbol from the table, instead
+    // of interning the name again for every statement.
+    std::optional<NamedInstruction> find_named_instr(std::string_view name) const {
+        return this->table->find_named_instr(name);
+    }
+    TaxStrat tax_strat(InstructionID instr);
+    TaxStrat tax_strat(InstructionID instr) const {
+        return this->table->tax_strat(instr);
+    }
+    std::optional<uint64_t> fingerprint();
+    bool concurrent_lookups();
+    bool concurrent_lookups() const {
+        return true;
+    }
 };
 
 class RootStateMachine: public StateMachine {
@@ -21,23 +112,61 @@ class RootStateMachine: public StateMachine {
     Env& env;
     Disk& disk;
     IDGenerator& id_gen;
+    CommandCache* cache;
     std::vector<CommandInstr> command_instrs;
+    std::unordered_map<std::string, size_t> name_index;
+    std::unordered_map<InstructionID, size_t> id_index;
+    bool lazy;
+    std::vector<std::string> lazy_paths;
+    std::unordered_set<std::string> lazy_misses;
+    // Taken by init(), never written while lookups may run concurrently.
+    std::optional<uint64_t> table_fingerprint;
 
-    void load_cmd_instrs(const std::string& path);
+    void load_cmd_instrs(const std::vector<std::string>& paths, size_t scan_threads);
+    void add_cmd_instr(const CommandInstr& instr);
+    std::optional<size_t> cmd_instr_index(const std::string& name);
+    std::optional<size_t> resolve_cmd_instr(const std::string& name);
+    std::optional<CommandCacheKey> cache_key(const std::string& path_var, const std::vector<std::string>& paths);
 
     public:
     RootStateMachine(Env& env, Disk& disk, IDGenerator& id_gen) :
         env(env),
         disk(disk),
         id_gen(id_gen),
-        command_instrs({}) {}
+        cache(nullptr),
+        command_instrs({}),
+        name_index({}),
+        id_index({}),
+        lazy(false) {}
+
+    RootStateMachine(Env& env, Disk& disk, IDGenerator& id_gen, CommandCache& cache) :
+        env(env),
+        disk(disk),
+        id_gen(id_gen),
+        cache(&cache),
+        command_instrs({}),
+        name_index({}),
+        id_index({}),
+        lazy(false) {}
 
     std::optional<CommandInstr> get_cmd_instr(const std::string& name);
     InstructionID new_instr_id();
 
     void init();
+    // Lists the PATH directories on up to scan_threads threads. Commands are
+    // still registered in PATH order, so ids and shadowing do not depend on
+    // which directory finished listing first.
+    void init(size_t scan_threads);
+    // Resolves commands against PATH only when they are first looked up,
+    // instead of listing every PATH directory up front.
+    void init_lazy();
     std::optional<InstructionID> find_instr(const std::string& name);
     TaxStrat tax_strat(InstructionID instr);
+    std::optional<uint64_t> fingerprint();
+    bool concurrent_lookups();
+    // Snapshot of the commands known so far. A lazy machine only knows the
+    // commands it already resolved, so freeze it after init().
+    FrozenStateMachine freeze() const;
 };
 
 class SequentialIDGenerator: public IDGenerator {
@@ -0,0 +1,184 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+#include "bench.h"
+#include "state_machine.h"
+#include "thread_pool.h"
+
+namespace fs = std::filesystem;
+
+const size_t BENCH_PATH_DIRS = 10;
+const size_t BENCH_FILES_PER_DIR = 1000;
+
+class BenchDisk: public Disk {
+    public:
+    std::vector<File> ls(const std::string& path) {
+        std::vector<File> files;
+        for (size_t idx = 0; idx < BENCH_FILES_PER_DIR; idx++) {
+            const std::string name = "cmd" + std::to_string(idx) + "_" + path.substr(path.rfind('/') + 1);
+            files.push_back({ .path = path + "/" + name, .name = name, .can_execute = true });
+        }
+        return files;
+    }
+};
+
+class BenchEnv: public Env {
+    public:
+    std::string var(const std::string& name) {
+        std::string path;
+        for (size_t idx = 0; idx < BENCH_PATH_DIRS; idx++) {
+            path += "/bench/bin" + std::to_string(idx) + ":";
+        }
+        return path;
+    }
+};
+
+std::vector<std::string> bench_lookup_names() {
+    std::vector<std::string> names;
+    for (size_t idx = 0; idx < 64; idx++) {
+        names.push_back("cmd" + std::to_string((idx * 7919) % BENCH_FILES_PER_DIR) + "_bin" + std::to_string(idx % BENCH_PATH_DIRS));
+    }
+    names.push_back("not_on_path");
+    return names;
+}
+
+int find_instr_bench = register_bench("StateMachine/FindInstr/10k", [](BenchState& state) {
+    BenchDisk disk;
+    BenchEnv env;
+    SequentialIDGenerator id_gen;
+    RootStateMachine machine = RootStateMachine(env, disk, id_gen);
+    machine.init();
+    const std::vector<std::string> names = bench_lookup_names();
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (const std::string& name : names) {
+            keep(machine.find_instr(name));
+        }
+    }
+    state.items = names.size();
+});
+
+int tax_strat_bench = register_bench("StateMachine/TaxStrat/10k", [](BenchState& state) {
+    BenchDisk disk;
+    BenchEnv env;
+    SequentialIDGenerator id_gen;
+    RootStateMachine machine = RootStateMachine(env, disk, id_gen);
+    machine.init();
+    std::vector<InstructionID> ids;
+    for (const std::string& name : bench_lookup_names()) {
+        ids.push_back(machine.find_instr(name).value_or(0));
+    }
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (InstructionID id : ids) {
+            keep(machine.tax_strat(id));
+        }
+    }
+    state.items = ids.size();
+});
+
+// Same lookups through a snapshot shared by several threads.
+int frozen_find_instr_bench = register_bench("StateMachine/FrozenFindInstr/10k/4threads", [](BenchState& state) {
+    BenchDisk disk;
+    BenchEnv env;
+    SequentialIDGenerator id_gen;
+    RootStateMachine machine = RootStateMachine(env, disk, id_gen);
+    machine.init();
+    const FrozenStateMachine frozen = machine.freeze();
+    const std::vector<std::string> names = bench_lookup_names();
+    ThreadPool pool(4);
+
+    state.start();
+    pool.run(4, [&](size_t) {
+        for (size_t iter = 0; iter < state.iterations; iter++) {
+            for (const std::string& name : names) {
+                keep(frozen.find_instr(name));
+            }
+        }
+    });
+    state.items = names.size() * 4;
+});
+
+// Reference point for the indexed lookups above: the linear scan over the
+// command table that find_instr used to do.
+int linear_lookup_bench = register_bench("StateMachine/LinearScan/10k", [](BenchState& state) {
+    BenchDisk disk;
+    std::vector<CommandInstr> instrs;
+    InstructionID id = 0;
+    for (size_t dir = 0; dir < BENCH_PATH_DIRS; dir++) {
+        for (File file : disk.ls("/bench/bin" + std::to_string(dir))) {
+            instrs.push_back({ .id = ++id, .name = file.name, .path = file.path });
+        }
+    }
+    const std::vector<std::string> names = bench_lookup_names();
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (const std::string& name : names) {
+            keep(std::find_if(instrs.begin(), instrs.end(), [&](const CommandInstr& instr) { return instr.name == name; }));
+        }
+    }
+    state.items = names.size();
+});
+
+const size_t TREE_PATH_DIRS = 16;
+const size_t TREE_FILES_PER_DIR = 400;
+
+// A PATH of real directories filled with executables, built once per run.
+class TreeEnv: public Env {
+    private:
+    std::string path;
+
+    public:
+    TreeEnv() {
+        const fs::path root = fs::temp_directory_path() / "lorikeet_bench_path";
+        for (size_t dir = 0; dir < TREE_PATH_DIRS; dir++) {
+            const fs::path bin = root / ("bin" + std::to_string(dir));
+            fs::create_directories(bin);
+            for (size_t idx = 0; idx < TREE_FILES_PER_DIR; idx++) {
+                const fs::path file = bin / ("tool" + std::to_string(idx));
+                if (!fs::exists(file)) {
+                    std::ofstream(file) << "#!/bin/sh\n";
+                    fs::permissions(file, fs::perms::owner_all);
+                }
+            }
+            this->path += bin.string() + ":";
+        }
+    }
+
+    std::string var(const std::string& name) {
+        return name == "PATH" ? this->path : "";
+    }
+};
+
+TreeEnv& tree_env() {
+    static TreeEnv env;
+    return env;
+}
+
+void init_tree_bench(BenchState& state, size_t scan_threads) {
+    TreeEnv& env = tree_env();
+    FileSystemDisk disk;
+    SequentialIDGenerator id_gen;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        RootStateMachine machine = RootStateMachine(env, disk, id_gen);
+        machine.init(scan_threads);
+        keep(machine);
+    }
+    state.items = TREE_PATH_DIRS * TREE_FILES_PER_DIR;
+}
+
+int init_sequential_bench = register_bench("StateMachine/InitTree/1thread", [](BenchState& state) {
+    init_tree_bench(state, 1);
+});
+
+int init_parallel_bench = register_bench("StateMachine/InitTree/hwthreads", [](BenchState& state) {
+    init_tree_bench(state, hardware_threads());
+});
@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+#include <utility>
+
 #include "state_machine.h"
 
 class TestDisk: public Disk {
@@ -30,6 +34,11 @@ class TestDisk: public Disk {
                     .path = "/usr/local/bin/textdata",
                     .name = "make",
                     .can_execute = false
+                },
+                {
+                    .path = "/usr/local/bin/cat",
+                    .name = "cat",
+                    .can_execute = true
                 }
             };
         }
@@ -67,3 +76,255 @@ TEST(Line, LoadCommandsInPath) {
     EXPECT_EQ(machine.get_cmd_instr("textdata"), std::nullopt);
 }
 
+
+TEST(Line, EarlierPathEntriesShadowLaterOnes) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+
+    machine.init();
+
+    CommandInstr instr = { .id = 2, .name = "cat", .path = "/usr/bin/cat" };
+    EXPECT_EQ(machine.get_cmd_instr("cat").value(), instr);
+    EXPECT_EQ(machine.find_instr("cat"), std::optional<InstructionID>(2));
+}
+
+TEST(Line, TaxStratByInstructionID) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+
+    machine.init();
+
+    EXPECT_EQ(machine.tax_strat(machine.find_instr("make").value()).parse_strat, ParseStrat::Command);
+    EXPECT_EQ(machine.tax_strat(4).parse_strat, ParseStrat::Command);
+    EXPECT_EQ(machine.tax_strat(1000).parse_strat, ParseStrat::Value);
+}
+
+class StampedDisk: public TestDisk {
+    public:
+    std::atomic<size_t> ls_calls = 0;
+
+    std::vector<File> ls(const std::string& path) {
+        this->ls_calls++;
+        return TestDisk::ls(path);
+    }
+
+    std::optional<DirStamp> stamp(const std::string& path) {
+        return DirStamp{ .inode = path.size(), .mtime_ns = 1 };
+    }
+};
+
+class MemoryCommandCache: public CommandCache {
+    public:
+    std::optional<CommandCacheKey> key;
+    std::vector<CommandInstr> instrs;
+
+    std::optional<std::vector<CommandInstr>> load(const CommandCacheKey& key) {
+        if (!this->key.has_value() || this->key.value().path_var != key.path_var || this->key.value().stamps != key.stamps) {
+            return std::nullopt;
+        }
+        return this->instrs;
+    }
+
+    void store(const CommandCacheKey& key, const std::vector<CommandInstr>& instrs) {
+        this->key = key;
+        this->instrs = instrs;
+    }
+};
+
+TEST(Line, CachedCommandsSkipDirectoryListing) {
+    StampedDisk stamped_disk = StampedDisk();
+    MemoryCommandCache cache = MemoryCommandCache();
+    SequentialIDGenerator ids = SequentialIDGenerator();
+
+    RootStateMachine first = RootStateMachine(env, stamped_disk, ids, cache);
+    first.init();
+    const size_t ls_calls = stamped_disk.ls_calls;
+    EXPECT_GT(ls_calls, 0);
+
+    RootStateMachine second = RootStateMachine(env, stamped_disk, ids, cache);
+    second.init();
+    EXPECT_EQ(stamped_disk.ls_calls, ls_calls);
+
+    EXPECT_EQ(second.get_cmd_instr("make"), first.get_cmd_instr("make"));
+    EXPECT_EQ(second.get_cmd_instr("cat"), first.get_cmd_instr("cat"));
+}
+
+class ProbingDisk: public TestDisk {
+    public:
+    std::atomic<size_t> ls_calls = 0;
+    size_t find_calls = 0;
+
+    std::vector<File> ls(const std::string& path) {
+        this->ls_calls++;
+        return TestDisk::ls(path);
+    }
+
+    std::optional<File> find(const std::string& dir, const std::string& name) {
+        this->find_calls++;
+        for (const File& file : TestDisk::ls(dir)) {
+            if (file.name == name && file.can_execute) {
+                return file;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+TEST(Line, LazyResolutionOnlyProbesUsedNames) {
+    ProbingDisk probing_disk = ProbingDisk();
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, probing_disk, ids);
+
+    machine.init_lazy();
+    EXPECT_EQ(probing_disk.ls_calls, 0);
+    EXPECT_EQ(probing_disk.find_calls, 0);
+
+    CommandInstr instr = { .id = 1, .name = "make", .path = "/usr/local/bin/make" };
+    EXPECT_EQ(machine.get_cmd_instr("make").value(), instr);
+    EXPECT_EQ(machine.find_instr("make"), std::optional<InstructionID>(1));
+    EXPECT_EQ(machine.tax_strat(1).parse_strat, ParseStrat::Command);
+
+    instr = { .id = 2, .name = "cat", .path = "/usr/bin/cat" };
+    EXPECT_EQ(machine.get_cmd_instr("cat").value(), instr);
+    EXPECT_EQ(probing_disk.ls_calls, 0);
+}
+
+TEST(Line, LazyResolutionRemembersMisses) {
+    ProbingDisk probing_disk = ProbingDisk();
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, probing_disk, ids);
+
+    machine.init_lazy();
+    EXPECT_EQ(machine.find_instr("non_existant"), std::nullopt);
+    const size_t find_calls = probing_disk.find_calls;
+    EXPECT_GT(find_calls, 0);
+
+    EXPECT_EQ(machine.find_instr("non_existant"), std::nullopt);
+    EXPECT_EQ(probing_disk.find_calls, find_calls);
+}
+
+TEST(Line, ParallelScanKeepsPathOrder) {
+    SequentialIDGenerator sequential_ids = SequentialIDGenerator();
+    RootStateMachine sequential = RootStateMachine(env, disk, sequential_ids);
+    sequential.init(1);
+
+    SequentialIDGenerator parallel_ids = SequentialIDGenerator();
+    RootStateMachine parallel = RootStateMachine(env, disk, parallel_ids);
+    parallel.init(4);
+
+    for (const char* name : {"echo", "cat", "make"}) {
+        EXPECT_EQ(parallel.get_cmd_instr(name), sequential.get_cmd_instr(name));
+    }
+}
+
+TEST(Line, FingerprintFollowsCommandTable) {
+    SequentialIDGenerator first_ids = SequentialIDGenerator();
+    SequentialIDGenerator second_ids = SequentialIDGenerator();
+    RootStateMachine first = RootStateMachine(env, disk, first_ids);
+    RootStateMachine second = RootStateMachine(env, disk, second_ids);
+    first.init();
+    second.init();
+
+    ASSERT_TRUE(first.fingerprint().has_value());
+    EXPECT_EQ(first.fingerprint(), second.fingerprint());
+
+    second_ids.new_instr_id();
+    RootStateMachine shifted = RootStateMachine(env, disk, second_ids);
+    shifted.init();
+    EXPECT_NE(shifted.fingerprint(), first.fingerprint());
+
+    RootStateMachine lazy = RootStateMachine(env, disk, first_ids);
+    lazy.init_lazy();
+    EXPECT_EQ(lazy.fingerprint(), std::nullopt);
+}
+
+TEST(Line, OnlyEagerLookupsAreConcurrent) {
+    RootStateMachine eager = RootStateMachine(env, disk, id_gen);
+    RootStateMachine lazy = RootStateMachine(env, disk, id_gen);
+    eager.init();
+    lazy.init_lazy();
+
+    EXPECT_TRUE(eager.concurrent_lookups());
+    EXPECT_FALSE(lazy.concurrent_lookups());
+}
+
+TEST(Line, FrozenMachineAnswersLikeRoot) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+    machine.init();
+
+    const FrozenStateMachine frozen = machine.freeze();
+
+    for (const std::string name : {"echo", "cat", "make", "textdata", "non_existant"}) {
+        EXPECT_EQ(frozen.find_instr(name), machine.find_instr(name));
+        EXPECT_EQ(frozen.instructions().get_cmd_instr(name), machine.get_cmd_instr(name));
+    }
+    EXPECT_EQ(frozen.tax_strat(4).parse_strat, ParseStrat::Command);
+    EXPECT_EQ(frozen.tax_strat(1000).parse_strat, ParseStrat::Value);
+    EXPECT_EQ(FrozenStateMachine(frozen).fingerprint(), machine.fingerprint());
+}
+
+TEST(Line, FrozenMachineKeepsItsSnapshot) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+    machine.init_lazy();
+    machine.find_instr("echo");
+
+    const FrozenStateMachine frozen = machine.freeze();
+    machine.find_instr("make");
+
+    EXPECT_EQ(frozen.instructions().size(), 1);
+    EXPECT_TRUE(frozen.find_instr("echo").has_value());
+    EXPECT_EQ(frozen.find_instr("make"), std::nullopt);
+}
+
+TEST(Line, FrozenMachineCopiesShareTable) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+    machine.init();
+
+    const FrozenStateMachine frozen = machine.freeze();
+    FrozenStateMachine copy = frozen;
+
+    EXPECT_EQ(&copy.instructions(), &frozen.instructions());
+    EXPECT_TRUE(copy.concurrent_lookups());
+}
+
+TEST(Line, FrozenMachineReturnsInternedNames) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+    machine.init();
+
+    const FrozenStateMachine frozen = machine.freeze();
+    const std::optional<NamedInstruction> found = frozen.find_named_instr("make");
+
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->id, frozen.find_instr("make"));
+    EXPECT_EQ(found->name, Symbol("make"));
+    EXPECT_EQ(frozen.find_named_instr("non_existant"), std::nullopt);
+}
+
+TEST(Line, FrozenMachineLooksUpFromManyThreads) {
+    SequentialIDGenerator ids = SequentialIDGenerator();
+    RootStateMachine machine = RootStateMachine(env, disk, ids);
+    machine.init();
+    const FrozenStateMachine frozen = machine.freeze();
+    const std::optional<InstructionID> expected = frozen.find_instr("make");
+    std::atomic<size_t> mismatches = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < 4; thread++) {
+        threads.emplace_back([&]() {
+            for (size_t idx = 0; idx < 10000; idx++) {
+                if (frozen.find_instr("make") != expected || frozen.find_instr("missing").has_value()) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(mismatches, 0);
+}
@@ -0,0 +1,80 @@
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "symbol.h"
+
+// Strings are kept in a deque so the views the index is keyed on stay put
+// as symbols are added. Lookups of known names, by far the most common,
+// only take the lock shared.
+class SymbolTable {
+    private:
+    std::shared_mutex mutex;
+    std::deque<std::string> values;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    public:
+    SymbolTable() {
+        this->values.emplace_back();
+        this->ids.emplace(this->values.back(), 0);
+    }
+
+    uint32_t intern(std::string_view value) {
+        {
+            const std::shared_lock<std::shared_mutex> lock(this->mutex);
+            const auto found = this->ids.find(value);
+            if (found != this->ids.end()) {
+                return found->second;
+            }
+        }
+        const std::unique_lock<std::shared_mutex> lock(this->mutex);
+        const auto found = this->ids.find(value);
+        if (found != this->ids.end()) {
+            return found->second;
+        }
+        const uint32_t id = this->values.size();
+        this->values.emplace_back(value);
+        this->ids.emplace(this->values.back(), id);
+        return id;
+    }
+
+    std::optional<uint32_t> find(std::string_view value) {
+        const std::shared_lock<std::shared_mutex> lock(this->mutex);
+        const auto found = this->ids.find(value);
+        if (found == this->ids.end()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    std::string_view str(uint32_t id) {
+        const std::shared_lock<std::shared_mutex> lock(this->mutex);
+        return this->values[id];
+    }
+};
+
+SymbolTable& symbol_table() {
+    static SymbolTable table;
+    return table;
+}
+
+Symbol::Symbol(std::string_view value) : id(value.empty() ? 0 : symbol_table().intern(value)) {}
+
+std::optional<Symbol> Symbol::find(std::string_view value) {
+    const std::optional<uint32_t> id = symbol_table().find(value);
+    if (!id.has_value()) {
+        return std::nullopt;
+    }
+    Symbol symbol;
+    symbol.id = id.value();
+    return symbol;
+}
+
+std::string_view Symbol::str() const {
+    return symbol_table().str(this->id);
+}
+
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
+    return os << symbol.str();
+}
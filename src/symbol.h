@@ -0,0 +1,46 @@
+#ifndef LK_SYMBOL
+#define LK_SYMBOL
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Name interned into the symbol table of the program. Symbols of equal
+// strings have the same id, so they are compared and hashed as integers.
+// Interned strings are never released, only intern names that a script
+// can use a bounded number of, not arbitrary script text.
+class Symbol {
+    private:
+    uint32_t id;
+
+    public:
+    // The empty string.
+    Symbol() : id(0) {}
+    Symbol(std::string_view value);
+    Symbol(const std::string& value) : Symbol(std::string_view(value)) {}
+    Symbol(const char* value) : Symbol(std::string_view(value)) {}
+
+    // The symbol of value if it has been interned already, without
+    // interning it otherwise.
+    static std::optional<Symbol> find(std::string_view value);
+
+    std::string_view str() const;
+    uint32_t index() const {
+        return this->id;
+    }
+
+    bool operator==(const Symbol& other) const = default;
+    friend std::ostream& operator<<(std::ostream& os, const Symbol& symbol);
+};
+
+template <>
+struct std::hash<Symbol> {
+    size_t operator()(const Symbol& symbol) const {
+        return symbol.index();
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "symbol.h"
+#include "thread_pool.h"
+
+TEST(Symbol, EqualStringsShareId) {
+    const std::string name = "print";
+
+    EXPECT_EQ(Symbol("print"), Symbol(name));
+    EXPECT_EQ(Symbol("print").index(), Symbol(std::string_view(name)).index());
+    EXPECT_NE(Symbol("print"), Symbol("println"));
+}
+
+TEST(Symbol, KeepsItsString) {
+    const Symbol symbol = Symbol(std::string("hexdump"));
+
+    EXPECT_EQ(symbol.str(), "hexdump");
+    EXPECT_EQ(Symbol().str(), "");
+    EXPECT_EQ(Symbol(""), Symbol());
+}
+
+TEST(Symbol, FindDoesNotIntern) {
+    EXPECT_EQ(Symbol::find("never_interned_name"), std::nullopt);
+    EXPECT_EQ(Symbol::find("never_interned_name"), std::nullopt);
+
+    const Symbol symbol = Symbol("found_after_interning");
+    EXPECT_EQ(Symbol::find("found_after_interning"), symbol);
+}
+
+TEST(Symbol, InternsFromManyThreads) {
+    ThreadPool pool = ThreadPool(4);
+    std::vector<Symbol> symbols(400);
+
+    pool.run(symbols.size(), [&](size_t idx) {
+        symbols[idx] = Symbol("threaded" + std::to_string(idx % 20));
+    });
+
+    for (size_t idx = 0; idx < symbols.size(); idx++) {
+        EXPECT_EQ(symbols[idx], symbols[idx % 20]);
+        EXPECT_EQ(symbols[idx].str(), "threaded" + std::to_string(idx % 20));
+    }
+}
@@ -0,0 +1,456 @@
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <type_traits>
+#include <unistd.h>
+
+#include "taxonomy_cache.h"
+#include "flat_taxonomy.h"
+#include "hash.h"
+#include "ports.h"
+
+namespace fs = std::filesystem;
+
+const char TAXONOMY_MAGIC[8] = {'L', 'K', 'T', 'A', 'X', 'O', 0, 0};
+// Bump whenever the layout below or the way scripts are scanned changes,
+// both make previously stored taxonomies stale.
+const uint32_t TAXONOMY_VERSION = 3;
+const char TAXONOMY_SUFFIX[] = ".taxo";
+// Files being written before they are renamed into place. One that is older
+// than TAXONOMY_STAGING_TTL was left by a process that died mid store.
+const char TAXONOMY_STAGING_SUFFIX[] = ".staging";
+const std::chrono::hours TAXONOMY_STAGING_TTL = std::chrono::hours(1);
+
+// On disk layout, all integers in host byte order:
+//   TaxonomyHeader
+//   FlatStatement[statement_count]
+//   FlatBranch[branch_count]
+//   FlatLine[line_count]
+//   FlatToken[token_count]
+//   CachedError[error_count]
+//   int32_t statement_lines[statement_line_count]
+//   char text[text_size]
+struct TaxonomyHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t error_count;
+    TaxonomyKey key;
+    FlatRange routine;
+    uint32_t statement_count;
+    uint32_t branch_count;
+    uint32_t line_count;
+    uint32_t token_count;
+    uint32_t statement_line_count;
+    uint64_t text_size;
+};
+
+struct CachedError {
+    uint32_t kind;
+    uint32_t line_num;
+};
+
+static_assert(std::is_trivially_copyable_v<FlatStatement>);
+static_assert(std::is_trivially_copyable_v<FlatBranch>);
+static_assert(std::is_trivially_copyable_v<FlatLine>);
+static_assert(std::is_trivially_copyable_v<FlatToken>);
+
+bool TaxonomyKey::operator==(const TaxonomyKey& other) const {
+    return this->source_hash == other.source_hash
+        && this->source_size == other.source_size
+        && this->instr_fingerprint == other.instr_fingerprint;
+}
+
+std::optional<TaxonomyKey> taxonomy_key(std::string_view source, StateMachine& machine) {
+    const std::optional<uint64_t> fingerprint = machine.fingerprint();
+    if (!fingerprint.has_value()) {
+        return std::nullopt;
+    }
+    return TaxonomyKey{
+        .source_hash = content_hash(source),
+        .source_size = source.size(),
+        .instr_fingerprint = fingerprint.value()
+    };
+}
+
+template <typename T>
+void write_rows(std::ofstream& out, const std::vector<T>& rows) {
+    out.write(reinterpret_cast<const char*>(rows.data()), sizeof(T) * rows.size());
+}
+
+// For rows with padding: the fields are copied into zeroed memory so that
+// the same taxonomy always makes the same file.
+template <typename T, typename CopyFields>
+void write_padded_rows(std::ofstream& out, const std::vector<T>& rows, CopyFields copy_fields) {
+    std::vector<char> bytes(sizeof(T) * rows.size(), 0);
+    for (size_t idx = 0; idx < rows.size(); idx++) {
+        copy_fields(*reinterpret_cast<T*>(bytes.data() + sizeof(T) * idx), rows[idx]);
+    }
+    out.write(bytes.data(), bytes.size());
+}
+
+template <typename T>
+const char* read_rows(const char* at, size_t count, std::vector<T>& rows) {
+    rows.resize(count);
+    std::memcpy(rows.data(), at, sizeof(T) * count);
+    return at + sizeof(T) * count;
+}
+
+bool store_taxonomy(const std::string& file, const TaxonomyKey& key, const FileTaxonomy& taxonomy) {
+    const FlatTaxonomy flat = flatten(taxonomy);
+    std::vector<CachedError> errors;
+    errors.reserve(flat.errors.size());
+    for (const CompilationError& error : flat.errors) {
+        errors.push_back({ .kind = uint32_t(error.kind), .line_num = uint32_t(error.line_num) });
+    }
+
+    TaxonomyHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TAXONOMY_MAGIC, sizeof(TAXONOMY_MAGIC));
+    header.version = TAXONOMY_VERSION;
+    header.error_count = errors.size();
+    header.key = key;
+    header.routine = flat.routine;
+    header.statement_count = flat.statements.size();
+    header.branch_count = flat.branches.size();
+    header.line_count = flat.lines.size();
+    header.token_count = flat.tokens.size();
+    header.statement_line_count = flat.statement_lines.size();
+    header.text_size = flat.text.size();
+
+    if (!make_private_dir(fs::path(file).parent_path())) {
+        return false;
+    }
+    std::error_code err;
+    // Threads of one process may store the same key at once.
+    static std::atomic<uint64_t> tmp_count = 0;
+    const std::string tmp_file = file + "." + std::to_string(::getpid()) + "." + std::to_string(tmp_count++) + TAXONOMY_STAGING_SUFFIX;
+    {
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_rows(out, flat.statements);
+        write_padded_rows(out, flat.branches, [](FlatBranch& row, const FlatBranch& branch) {
+            row.default_branch = branch.default_branch;
+            row.input = branch.input;
+            row.routine = branch.routine;
+        });
+        write_rows(out, flat.lines);
+        write_padded_rows(out, flat.tokens, [](FlatToken& row, const FlatToken& token) {
+            row.kind = token.kind;
+            row.quote_mark = token.quote_mark;
+            row.flag_dashes = token.flag_dashes;
+            row.value = token.value;
+        });
+        write_rows(out, errors);
+        write_rows(out, flat.statement_lines);
+        out.write(flat.text.data(), flat.text.size());
+        if (!out) {
+            fs::remove(tmp_file, err);
+            return false;
+        }
+    }
+    fs::rename(tmp_file, file, err);
+    if (err) {
+        fs::remove(tmp_file, err);
+        return false;
+    }
+    return true;
+}
+
+bool in_rows(FlatRange range, size_t rows) {
+    return uint64_t(range.first) + range.count <= rows;
+}
+
+bool in_text(FlatString value, size_t text_size) {
+    return uint64_t(value.offset) + value.length <= text_size;
+}
+
+// flatten places the routine of every branch after the routine holding its
+// statement, and never hands out a statement row twice. Holding the tables
+// to that keeps unflatten from recursing forever or copying shared rows.
+bool valid_routines(const FlatTaxonomy& flat) {
+    std::vector<bool> claimed(flat.statements.size(), false);
+    std::vector<FlatRange> pending = { flat.routine };
+    while (!pending.empty()) {
+        const FlatRange routine = pending.back();
+        pending.pop_back();
+        for (uint32_t idx = routine.first; idx < routine.first + routine.count; idx++) {
+            if (claimed[idx]) {
+                return false;
+            }
+            claimed[idx] = true;
+            const FlatStatement& stmt = flat.statements[idx];
+            for (uint32_t branch_idx = stmt.branches.first; branch_idx < stmt.branches.first + stmt.branches.count; branch_idx++) {
+                const FlatBranch& branch = flat.branches[branch_idx];
+                if (uint64_t(branch.routine.first) < uint64_t(routine.first) + routine.count) {
+                    return false;
+                }
+                pending.push_back(branch.routine);
+            }
+        }
+    }
+    return true;
+}
+
+// The tables come from disk, every row they refer to must exist and every
+// value must be one the field's type can hold before unflatten may follow it.
+bool valid_tables(const FlatTaxonomy& flat) {
+    if (!in_rows(flat.routine, flat.statements.size())) {
+        return false;
+    }
+    for (const FlatStatement& stmt : flat.statements) {
+        if (!in_text(stmt.name, flat.text.size())
+            || !in_rows(stmt.input, flat.lines.size())
+            || !in_rows(stmt.branches, flat.branches.size())) {
+            return false;
+        }
+    }
+    for (const FlatBranch& branch : flat.branches) {
+        // Read as a byte, a bool holding anything but 0 or 1 is undefined.
+        uint8_t default_branch;
+        std::memcpy(&default_branch, &branch.default_branch, sizeof(default_branch));
+        if (default_branch > 1
+            || branch.input >= flat.lines.size()
+            || !in_rows(branch.routine, flat.statements.size())) {
+            return false;
+        }
+    }
+    for (const FlatLine& line : flat.lines) {
+        if (!in_rows(line.tokens, flat.tokens.size())) {
+            return false;
+        }
+    }
+    for (const FlatToken& token : flat.tokens) {
+        if (uint8_t(token.kind) > uint8_t(TokenKind::Flag)
+            || !in_text(token.value, flat.text.size())) {
+            return false;
+        }
+    }
+    return valid_routines(flat);
+}
+
+std::optional<CompilationError> cached_error(const CachedError& error) {
+    switch (ErrorKind(error.kind)) {
+    case ErrorKind::InstructionDoesNotAcceptBlock:
+        return instruction_does_not_accept_block(error.line_num);
+    case ErrorKind::InvalidIndentation:
+        return invalid_indentation(error.line_num);
+    case ErrorKind::UnknownInstruction:
+        return unknown_instruction(error.line_num);
+    case ErrorKind::UnreadableFile:
+        return unreadable_file();
+    }
+    return std::nullopt;
+}
+
+std::optional<FileTaxonomy> load_taxonomy(const std::string& file, const TaxonomyKey& key) {
+    const MappedFile mapped_file(file);
+    const std::string_view mapped = mapped_file.data();
+    if (!mapped_file.owned_by_user() || mapped.size() < sizeof(TaxonomyHeader)) {
+        return std::nullopt;
+    }
+    TaxonomyHeader header;
+    std::memcpy(&header, mapped.data(), sizeof(header));
+    if (std::memcmp(header.magic, TAXONOMY_MAGIC, sizeof(TAXONOMY_MAGIC)) != 0
+        || header.version != TAXONOMY_VERSION
+        || !(header.key == key)) {
+        return std::nullopt;
+    }
+    const uint64_t size = sizeof(TaxonomyHeader)
+        + sizeof(FlatStatement) * uint64_t(header.statement_count)
+        + sizeof(FlatBranch) * uint64_t(header.branch_count)
+        + sizeof(FlatLine) * uint64_t(header.line_count)
+        + sizeof(FlatToken) * uint64_t(header.token_count)
+        + sizeof(CachedError) * uint64_t(header.error_count)
+        + sizeof(int32_t) * uint64_t(header.statement_line_count)
+        + header.text_size;
+    if (size != mapped.size()) {
+        return std::nullopt;
+    }
+
+    FlatTaxonomy flat = { .routine = header.routine };
+    std::vector<CachedError> errors;
+    const char* at = mapped.data() + sizeof(TaxonomyHeader);
+    at = read_rows(at, header.statement_count, flat.statements);
+    at = read_rows(at, header.branch_count, flat.branches);
+    at = read_rows(at, header.line_count, flat.lines);
+    at = read_rows(at, header.token_count, flat.tokens);
+    at = read_rows(at, header.error_count, errors);
+    at = read_rows(at, header.statement_line_count, flat.statement_lines);
+    flat.text.assign(at, header.text_size);
+    if (!valid_tables(flat)) {
+        return std::nullopt;
+    }
+    for (const CachedError& error : errors) {
+        const std::optional<CompilationError> compile_err = cached_error(error);
+        if (!compile_err.has_value()) {
+            return std::nullopt;
+        }
+        flat.errors.push_back(compile_err.value());
+    }
+    return unflatten(flat);
+}
+
+// Scans source unless lookup has a taxonomy for its key, and hands
+// successful scans to store.
+template <typename Lookup, typename Store>
+FileTaxonomy scan_source_cached(std::string_view source, StateMachine& machine, Lookup lookup, Store store) {
+    const std::optional<TaxonomyKey> key = taxonomy_key(source, machine);
+    if (key.has_value()) {
+        std::optional<FileTaxonomy> cached = lookup(key.value());
+        if (cached.has_value()) {
+            return std::move(cached.value());
+        }
+    }
+    FileTaxonomy file = scan_source(source, machine);
+    if (key.has_value() && file.errors.empty()) {
+        store(key.value(), file);
+    }
+    return file;
+}
+
+FileTaxonomy scan_path_cached(const std::string& path, StateMachine& machine, const std::string& cache_file) {
+    const MappedFile source(path);
+    if (!source.open()) {
+        return { .errors = { unreadable_file() } };
+    }
+    return scan_source_cached(source.data(), machine, [&](const TaxonomyKey& key) {
+        return load_taxonomy(cache_file, key);
+    }, [&](const TaxonomyKey& key, const FileTaxonomy& file) {
+        store_taxonomy(cache_file, key, file);
+    });
+}
+
+TaxonomyCacheDir::TaxonomyCacheDir(const std::string& dir, uint64_t max_bytes) :
+    dir(dir),
+    max_bytes(max_bytes),
+    hits(0),
+    misses(0),
+    stores(0),
+    evictions(0),
+    tracked_bytes(UNKNOWN_CACHE_BYTES) {}
+
+std::string TaxonomyCacheDir::entry_file(const TaxonomyKey& key) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx%016llx",
+        static_cast<unsigned long long>(key.source_hash),
+        static_cast<unsigned long long>(content_hash(key.source_size, key.instr_fingerprint)));
+    return this->dir + "/" + name + TAXONOMY_SUFFIX;
+}
+
+std::optional<FileTaxonomy> TaxonomyCacheDir::load(const TaxonomyKey& key) {
+    const std::string file = this->entry_file(key);
+    std::optional<FileTaxonomy> taxonomy = load_taxonomy(file, key);
+    if (!taxonomy.has_value()) {
+        this->misses++;
+        return std::nullopt;
+    }
+    this->hits++;
+    // The modification time doubles as the last use for eviction.
+    std::error_code err;
+    fs::last_write_time(file, fs::file_time_type::clock::now(), err);
+    return taxonomy;
+}
+
+void TaxonomyCacheDir::store(const TaxonomyKey& key, const FileTaxonomy& taxonomy) {
+    const std::string file = this->entry_file(key);
+    if (!store_taxonomy(file, key, taxonomy)) {
+        return;
+    }
+    this->stores++;
+    std::error_code err;
+    const uint64_t stored = fs::file_size(file, err);
+    const uint64_t size = err ? 0 : stored;
+    uint64_t tracked = this->tracked_bytes.load();
+    while (tracked != UNKNOWN_CACHE_BYTES && !this->tracked_bytes.compare_exchange_weak(tracked, tracked + size)) {}
+    if (this->tracked_bytes.load() > this->max_bytes) {
+        this->evict();
+    }
+}
+
+struct CacheEntry {
+    fs::path path;
+    fs::file_time_type used;
+    uint64_t size;
+};
+
+// Staged files count towards the cap like entries, those left behind by a
+// process that died before renaming them are removed, the others are still
+// being written and are left alone.
+void TaxonomyCacheDir::evict() {
+    std::vector<CacheEntry> entries;
+    uint64_t total = 0;
+    std::error_code err;
+    const fs::file_time_type stale = fs::file_time_type::clock::now() - TAXONOMY_STAGING_TTL;
+    for (fs::directory_iterator it(this->dir, err), end; !err && it != end; it.increment(err)) {
+        const fs::path extension = it->path().extension();
+        if (extension != TAXONOMY_SUFFIX && extension != TAXONOMY_STAGING_SUFFIX) {
+            continue;
+        }
+        std::error_code stat_err;
+        const uint64_t size = it->file_size(stat_err);
+        const fs::file_time_type used = it->last_write_time(stat_err);
+        if (stat_err) {
+            continue;
+        }
+        if (extension == TAXONOMY_STAGING_SUFFIX) {
+            std::error_code remove_err;
+            if (used >= stale || !fs::remove(it->path(), remove_err)) {
+                total += size;
+            }
+            continue;
+        }
+        entries.push_back({ .path = it->path(), .used = used, .size = size });
+        total += size;
+    }
+    if (total <= this->max_bytes) {
+        this->tracked_bytes = total;
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.used < b.used;
+    });
+    for (const CacheEntry& entry : entries) {
+        if (total <= this->max_bytes) {
+            break;
+        }
+        // Another process evicting at the same time may have removed it
+        // already, the space is freed either way.
+        if (fs::remove(entry.path, err)) {
+            this->evictions++;
+        }
+        total -= entry.size;
+    }
+    this->tracked_bytes = total;
+}
+
+FileTaxonomy TaxonomyCacheDir::scan_path(const std::string& path, StateMachine& machine) {
+    const MappedFile source(path);
+    if (!source.open()) {
+        return { .errors = { unreadable_file() } };
+    }
+    return scan_source_cached(source.data(), machine, [&](const TaxonomyKey& key) {
+        return this->load(key);
+    }, [&](const TaxonomyKey& key, const FileTaxonomy& file) {
+        this->store(key, file);
+    });
+}
+
+TaxonomyCacheStats TaxonomyCacheDir::stats() const {
+    return {
+        .hits = this->hits.load(),
+        .misses = this->misses.load(),
+        .stores = this->stores.load(),
+        .evictions = this->evictions.load()
+    };
+}
+
+std::optional<std::string> taxonomy_cache_dir(Env& env) {
+    const std::optional<std::string> dir = cache_dir(env);
+    if (!dir.has_value()) {
+        return std::nullopt;
+    }
+    return dir.value() + "/taxonomies";
+}
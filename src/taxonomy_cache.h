@@ -0,0 +1,91 @@
+#ifndef LK_TAXONOMY_CACHE
+#define LK_TAXONOMY_CACHE
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <cstdint>
+#include <atomic>
+
+#include "taxscan.h"
+#include "flat_taxonomy.h"
+#include "state_machine.h"
+#include "ports.h"
+
+// A scanned taxonomy is only valid for the exact source it was scanned
+// from and the instruction table it was scanned against.
+struct TaxonomyKey {
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t instr_fingerprint;
+
+    bool operator==(const TaxonomyKey& other) const;
+};
+
+// Has no value when the machine has no fingerprint to key the scan on.
+std::optional<TaxonomyKey> taxonomy_key(std::string_view source, StateMachine& machine);
+
+// Writes the taxonomy as one versioned binary file. Writes go to a
+// temporary file that is renamed over the old one, so concurrent readers
+// never see a partially written taxonomy.
+bool store_taxonomy(const std::string& file, const TaxonomyKey& key, const FileTaxonomy& taxonomy);
+// Memory maps file and rebuilds the taxonomy stored in it, if it was
+// stored under key by this version of lorikeet.
+std::optional<FileTaxonomy> load_taxonomy(const std::string& file, const TaxonomyKey& key);
+
+// Whether tables read back from disk are safe to unflatten: every row
+// they refer to exists and the routines form a tree.
+bool valid_tables(const FlatTaxonomy& flat);
+
+// Scans the script at path, reusing the taxonomy in cache_file when it was
+// stored for the same source and instruction table. Successful scans are
+// stored to cache_file for the next run.
+FileTaxonomy scan_path_cached(const std::string& path, StateMachine& machine, const std::string& cache_file);
+
+struct TaxonomyCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+};
+
+const uint64_t DEFAULT_TAXONOMY_CACHE_BYTES = 256 * 1024 * 1024;
+const uint64_t UNKNOWN_CACHE_BYTES = UINT64_MAX;
+
+// Directory of stored taxonomies, one file per key, shared by every
+// lorikeet process on the host. Loading a hit touches its file, and a store
+// that takes the directory over max_bytes removes the least recently used
+// files until it fits again. Files are only ever replaced by rename, so a
+// process that still maps an evicted or replaced file keeps reading it.
+// Other processes' stores are only seen at the next listing, so the
+// directory can go over max_bytes until one of them lists it.
+class TaxonomyCacheDir {
+    private:
+    std::string dir;
+    uint64_t max_bytes;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> stores;
+    std::atomic<uint64_t> evictions;
+    // Size of the directory when this process last listed it, plus what it
+    // stored since. Stores only list the directory again once this passes
+    // max_bytes, UNKNOWN_CACHE_BYTES until the first listing.
+    std::atomic<uint64_t> tracked_bytes;
+
+    void evict();
+
+    public:
+    TaxonomyCacheDir(const std::string& dir, uint64_t max_bytes = DEFAULT_TAXONOMY_CACHE_BYTES);
+
+    std::string entry_file(const TaxonomyKey& key) const;
+    std::optional<FileTaxonomy> load(const TaxonomyKey& key);
+    void store(const TaxonomyKey& key, const FileTaxonomy& taxonomy);
+    // Same as scan_path_cached, with the cache file picked by key.
+    FileTaxonomy scan_path(const std::string& path, StateMachine& machine);
+    // Counts of this process only.
+    TaxonomyCacheStats stats() const;
+};
+
+std::optional<std::string> taxonomy_cache_dir(Env& env);
+
+#endif
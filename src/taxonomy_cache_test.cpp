@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "taxonomy_cache.h"
+#include "test_util.h"
+
+namespace fs = std::filesystem;
+
+class CountingStateMachine: public StateMachine {
+    public:
+    size_t lookups = 0;
+    std::optional<uint64_t> table = 42;
+
+    std::optional<InstructionID> find_instr(const std::string& name) {
+        this->lookups++;
+        if (name == "if") {
+            return 1;
+        }
+        if (name == "print") {
+            return 2;
+        }
+        return std::nullopt;
+    }
+
+    TaxStrat tax_strat(InstructionID instr) {
+        if (instr == 1) {
+            return branch_strat({"else"});
+        }
+        return command_strat();
+    }
+
+    std::optional<uint64_t> fingerprint() {
+        return this->table;
+    }
+};
+
+const std::string CACHED_SCRIPT = "print 'A'\nif true\n\tprint 'B'\nelse\n\tprint 'C'\n";
+
+TEST(TaxonomyCache, LoadsWhatWasStored) {
+    CountingStateMachine machine;
+    const std::string file = temp_test_file("taxonomy.bin");
+    const FileTaxonomy taxonomy = scan_source(CACHED_SCRIPT, machine);
+    const TaxonomyKey key = taxonomy_key(CACHED_SCRIPT, machine).value();
+
+    ASSERT_TRUE(store_taxonomy(file, key, taxonomy));
+
+    EXPECT_EQ(load_taxonomy(file, key), taxonomy);
+}
+
+TEST(TaxonomyCache, OtherSourceOrTableMisses) {
+    CountingStateMachine machine;
+    const std::string file = temp_test_file("taxonomy_key.bin");
+    const TaxonomyKey key = taxonomy_key(CACHED_SCRIPT, machine).value();
+    store_taxonomy(file, key, scan_source(CACHED_SCRIPT, machine));
+
+    EXPECT_EQ(load_taxonomy(file, taxonomy_key(CACHED_SCRIPT + "print 'D'\n", machine).value()), std::nullopt);
+    machine.table = 43;
+    EXPECT_EQ(load_taxonomy(file, taxonomy_key(CACHED_SCRIPT, machine).value()), std::nullopt);
+}
+
+TEST(TaxonomyCache, TruncatedFileMisses) {
+    CountingStateMachine machine;
+    const std::string file = temp_test_file("taxonomy_truncated.bin");
+    const TaxonomyKey key = taxonomy_key(CACHED_SCRIPT, machine).value();
+    store_taxonomy(file, key, scan_source(CACHED_SCRIPT, machine));
+
+    fs::resize_file(file, fs::file_size(file) - 1);
+
+    EXPECT_EQ(load_taxonomy(file, key), std::nullopt);
+}
+
+TEST(TaxonomyCache, SameTaxonomyMakesSameFile) {
+    CountingStateMachine machine;
+    const std::string first = temp_test_file("taxonomy_first.bin");
+    const std::string second = temp_test_file("taxonomy_second.bin");
+    const TaxonomyKey key = taxonomy_key(CACHED_SCRIPT, machine).value();
+    store_taxonomy(first, key, scan_source(CACHED_SCRIPT, machine));
+    store_taxonomy(second, key, scan_source(CACHED_SCRIPT, machine));
+
+    std::ifstream first_in(first, std::ios::binary);
+    std::ifstream second_in(second, std::ios::binary);
+    const std::string first_bytes((std::istreambuf_iterator<char>(first_in)), std::istreambuf_iterator<char>());
+    const std::string second_bytes((std::istreambuf_iterator<char>(second_in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(first_bytes, second_bytes);
+}
+
+TEST(TaxonomyCache, RejectsTablesUnflattenCannotFollow) {
+    CountingStateMachine machine;
+    const FlatTaxonomy flat = flatten(scan_source(CACHED_SCRIPT, machine));
+    ASSERT_TRUE(valid_tables(flat));
+
+    FlatTaxonomy own_routine = flat;
+    own_routine.branches[0].routine = own_routine.routine;
+    EXPECT_FALSE(valid_tables(own_routine));
+
+    FlatTaxonomy shared_routine = flat;
+    shared_routine.branches[1].routine = shared_routine.branches[0].routine;
+    EXPECT_FALSE(valid_tables(shared_routine));
+
+    FlatTaxonomy bad_kind = flat;
+    bad_kind.tokens[0].kind = TokenKind(uint8_t(TokenKind::Flag) + 1);
+    EXPECT_FALSE(valid_tables(bad_kind));
+
+    FlatTaxonomy bad_bool = flat;
+    const uint8_t two = 2;
+    std::memcpy(&bad_bool.branches[0].default_branch, &two, sizeof(two));
+    EXPECT_FALSE(valid_tables(bad_bool));
+}
+
+TEST(TaxonomyCache, CachedScanSkipsScanning) {
+    CountingStateMachine machine;
+    const std::string script = temp_test_file("cached_script.lk");
+    const std::string file = temp_test_file("cached_script.bin");
+    std::ofstream(script) << CACHED_SCRIPT;
+
+    const FileTaxonomy scanned = scan_path_cached(script, machine, file);
+    const size_t lookups = machine.lookups;
+    const FileTaxonomy cached = scan_path_cached(script, machine, file);
+
+    EXPECT_GT(lookups, 0);
+    EXPECT_EQ(machine.lookups, lookups);
+    EXPECT_EQ(cached, scanned);
+}
+
+TEST(TaxonomyCache, MachineWithoutFingerprintIsNotCached) {
+    CountingStateMachine machine;
+    machine.table = std::nullopt;
+    const std::string script = temp_test_file("uncached_script.lk");
+    const std::string file = temp_test_file("uncached_script.bin");
+    std::ofstream(script) << CACHED_SCRIPT;
+
+    scan_path_cached(script, machine, file);
+
+    EXPECT_FALSE(fs::exists(file));
+}
+
+TEST(TaxonomyCache, DirCountsHitsAndMisses) {
+    CountingStateMachine machine;
+    TaxonomyCacheDir cache(temp_test_dir("taxonomies_counts"));
+    const std::string script = temp_test_file("dir_script.lk");
+    std::ofstream(script) << CACHED_SCRIPT;
+
+    const FileTaxonomy scanned = cache.scan_path(script, machine);
+    const FileTaxonomy cached = cache.scan_path(script, machine);
+
+    EXPECT_EQ(cached, scanned);
+    const TaxonomyCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.stores, 1);
+}
+
+TEST(TaxonomyCache, DirsShareEntries) {
+    CountingStateMachine machine;
+    const std::string dir = temp_test_dir("taxonomies_shared");
+    TaxonomyCacheDir first(dir);
+    TaxonomyCacheDir second(dir);
+    const TaxonomyKey key = taxonomy_key(CACHED_SCRIPT, machine).value();
+
+    first.store(key, scan_source(CACHED_SCRIPT, machine));
+
+    EXPECT_TRUE(second.load(key).has_value());
+    EXPECT_EQ(second.stats().hits, 1);
+}
+
+TEST(TaxonomyCache, DirEvictsLeastRecentlyUsed) {
+    CountingStateMachine machine;
+    const std::string dir = temp_test_dir("taxonomies_evict");
+    const std::vector<std::string> sources = {
+        CACHED_SCRIPT,
+        CACHED_SCRIPT + "print 'D'\n",
+        CACHED_SCRIPT + "print 'E'\n"
+    };
+    std::vector<TaxonomyKey> keys;
+    uint64_t entry_size = 0;
+    {
+        TaxonomyCacheDir unbounded(dir);
+        for (const std::string& source : sources) {
+            keys.push_back(taxonomy_key(source, machine).value());
+            unbounded.store(keys.back(), scan_source(source, machine));
+            entry_size = std::max<uint64_t>(entry_size, fs::file_size(unbounded.entry_file(keys.back())));
+        }
+    }
+    // Oldest use first: the second source, then the first, then the third.
+    TaxonomyCacheDir cache(dir, entry_size * 2);
+    const fs::file_time_type now = fs::file_time_type::clock::now();
+    fs::last_write_time(cache.entry_file(keys[1]), now - std::chrono::hours(2));
+    fs::last_write_time(cache.entry_file(keys[0]), now - std::chrono::hours(1));
+    fs::last_write_time(cache.entry_file(keys[2]), now);
+
+    cache.store(keys[2], scan_source(sources[2], machine));
+
+    EXPECT_FALSE(fs::exists(cache.entry_file(keys[1])));
+    EXPECT_TRUE(fs::exists(cache.entry_file(keys[0])));
+    EXPECT_TRUE(fs::exists(cache.entry_file(keys[2])));
+    EXPECT_EQ(cache.stats().evictions, 1);
+}
+
+// Writes a file named like the ones stores stage before renaming them.
+fs::path staged_file(const std::string& dir, const std::string& name, fs::file_time_type written) {
+    const fs::path file = fs::path(dir) / (name + ".taxo.1.0.staging");
+    std::ofstream(file) << "partial";
+    fs::last_write_time(file, written);
+    return file;
+}
+
+TEST(TaxonomyCache, DirRemovesStaleStagedFiles) {
+    CountingStateMachine machine;
+    const std::string dir = temp_test_dir("taxonomies_staged");
+    fs::create_directories(dir);
+    const fs::file_time_type now = fs::file_time_type::clock::now();
+    const fs::path stale = staged_file(dir, "stale", now - std::chrono::hours(2));
+    const fs::path writing = staged_file(dir, "writing", now);
+    TaxonomyCacheDir cache(dir, 1);
+
+    cache.store(taxonomy_key(CACHED_SCRIPT, machine).value(), scan_source(CACHED_SCRIPT, machine));
+
+    EXPECT_FALSE(fs::exists(stale));
+    EXPECT_TRUE(fs::exists(writing));
+}
+
+TEST(TaxonomyCache, DirOnlyListsWhenOverCap) {
+    CountingStateMachine machine;
+    const std::string dir = temp_test_dir("taxonomies_tracked");
+    const std::string second_source = CACHED_SCRIPT + "print 'D'\n";
+    TaxonomyCacheDir cache(dir);
+    cache.store(taxonomy_key(CACHED_SCRIPT, machine).value(), scan_source(CACHED_SCRIPT, machine));
+    const fs::path stale = staged_file(dir, "stale", fs::file_time_type::clock::now() - std::chrono::hours(2));
+
+    cache.store(taxonomy_key(second_source, machine).value(), scan_source(second_source, machine));
+
+    EXPECT_TRUE(fs::exists(stale));
+}
+
+class CacheEnv: public Env {
+    public:
+    std::string var(const std::string& name) {
+        if (name == "XDG_CACHE_HOME") {
+            return "/var/cache/jobs";
+        }
+        return "";
+    }
+};
+
+TEST(TaxonomyCache, DirLivesInUserCache) {
+    CacheEnv env;
+
+    EXPECT_EQ(taxonomy_cache_dir(env), "/var/cache/jobs/lorikeet/taxonomies");
+}
@@ -1,171 +1,593 @@
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <deque>
 
 #include "taxscan.h"
+#include "lexer.h"
+#include "thread_pool.h"
 
 FileTaxonomy empty_file_taxonomy() {
 	return { .routine = { .statements = {} } };
 }
 
-FileTaxonomy err_file(std::vector<CompilationError> errors) {
-    return { .routine = { .statements = {} }, .errors = errors };
+FileTaxonomy arena_file_taxonomy(std::pmr::memory_resource* upstream) {
+	std::shared_ptr<std::pmr::monotonic_buffer_resource> arena = std::make_shared<std::pmr::monotonic_buffer_resource>(upstream);
+	std::pmr::memory_resource* resource = arena.get();
+	return { .arena = std::move(arena), .routine = { .statements = std::pmr::vector<StatementTaxonomy>(resource) } };
 }
 
-void append_input(StatementTaxonomy& stmt, const std::vector<Line>& lines, int start, int count) {
-    for (int idx = start; idx < start + count; idx++) {
-        stmt.input.push_back(lines[idx]);
-	}
+FileTaxonomy err_file(std::vector<CompilationError> errors) {
+    return { .routine = { .statements = {} }, .errors = errors };
 }
 
-struct BlockResult {
-    std::vector<Line> lines;
-    size_t resume_at;
-    std::vector<CompilationError> errors;
+// What the next line of a routine can be, given the lines scanned so far.
+enum class ScanMode {
+    // A statement of the routine.
+    Statement,
+    // A statement, or the first line of a block of the last statement.
+    Lookahead,
+    // A branch of the last statement, or a statement.
+    Branches,
+    // The first line of the block of a branch line, or the line after it.
+    BranchBlock
 };
 
-struct BranchResult {
-    size_t resume_at;
-    std::vector<CompilationError> errors;
+// A block that is still open during the scan. The root frame holds the
+// routine of the file, every other frame holds a block of the last
+// statement in the frame below it.
+struct ScanFrame {
+    BlockFunction block_function;
+    // Levels of RoutineScanner::indentation that the statements of the
+    // frame are indented by.
+    size_t indentation;
+    RoutineTaxonomy* routine;
+    StatementTaxonomy* owner;
+    ScanMode mode;
+    StatementTaxonomy* stmt;
+    TaxStrat tax_strat;
+    const Line* branch_line;
 };
 
-void trim_lines(std::vector<Line>& lines);
+// Scan state carried from one line to the next, so a scan can stop after
+// any line and carry on with the next one later.
+class RoutineScanner {
+    private:
+    std::vector<ScanFrame> frames;
+    // Shared by all frames, a frame holds how many of the outermost levels
+    // it is indented by. Opening a block drops levels left by closed ones.
+    Indentation indentation;
+    bool is_multi_line_comment;
+
+    public:
+    RoutineScanner(RoutineTaxonomy& routine);
+
+    // Scanned lines must outlive the scanner, branch lines are kept until
+    // the line after them is scanned.
+    template <typename Machine>
+    std::optional<CompilationError> scan(const Line& line, Machine& machine);
+};
 
 bool skip_line(const Line& line, bool& is_multi_line_comment);
-BlockResult scan_block(const std::vector<Line>& lines, size_t starting_from, const Indentation& indentation);
-std::vector<CompilationError> scan_routine(const std::vector<Line>& lines, Indentation& indentation, RoutineTaxonomy& routine, StateMachine& machine);
-BranchResult scan_branches(const std::vector<Line>& lines, size_t from, TaxStrat tax_strat, Indentation& indentation, StatementTaxonomy& stmt, StateMachine& machine);
+template <typename Machine>
+std::vector<CompilationError> scan_routine(const std::vector<Line>& lines, RoutineTaxonomy& routine, std::vector<int>& statement_lines, Machine& machine);
 
-FileTaxonomy scan_file(const std::vector<std:: string>& lines_raw, StateMachine& machine) {
-    FileTaxonomy file = empty_file_taxonomy();
+template <typename Machine>
+FileTaxonomy scan_lines_parallel(const std::vector<Line>& lines, Machine& machine, size_t threads, std::pmr::memory_resource* upstream);
 
-    Indentation indentation;
-    std::vector<Line> lines;
-    parse(lines_raw, lines);
-    std::vector<CompilationError> errors = scan_routine(lines, indentation, file.routine, machine);
+// The scan is written once for any machine type. Scanning against
+// StateMachine looks up through its virtual functions, scanning against
+// a FrozenStateMachine calls its const lookups directly.
+template <typename Machine>
+FileTaxonomy scan_parsed(const std::vector<Line>& lines, Machine& machine, const ScanOptions& options) {
+    const size_t threads = options.threads == 0 ? hardware_threads() : options.threads;
+    if (lines.size() >= PARALLEL_SCAN_MIN_LINES && threads > 1 && machine.concurrent_lookups()) {
+        return scan_lines_parallel(lines, machine, threads, options.arena_upstream);
+    }
+    FileTaxonomy file = arena_file_taxonomy(options.arena_upstream);
+
+    std::vector<CompilationError> errors = scan_routine(lines, file.routine, file.statement_lines, machine);
     if (!errors.empty()) {
         return err_file(errors);
     }
     return file;
 }
 
-std::vector<CompilationError> scan_routine(const std::vector<Line>& lines, Indentation& indentation, RoutineTaxonomy& routine, StateMachine& machine) {
-    bool is_multi_line_comment = false;
-    for (size_t idx = 0; idx < lines.size(); idx++) {
-        const Line line = lines[idx];
-        if (skip_line(line, is_multi_line_comment)) {
-            continue;
+FileTaxonomy scan_lines(const std::vector<Line>& lines, StateMachine& machine, const ScanOptions& options) {
+    return scan_parsed(lines, machine, options);
+}
+
+FileTaxonomy scan_lines(const std::vector<Line>& lines, const FrozenStateMachine& machine, const ScanOptions& options) {
+    return scan_parsed(lines, machine, options);
+}
+
+// The parsed lines only live for the scan, so their tokens share a scratch
+// arena that is dropped as a whole once the taxonomy has been built.
+template <typename Machine>
+FileTaxonomy scan_raw(const std::vector<std::string>& lines_raw, Machine& machine, const ScanOptions& options) {
+    std::pmr::monotonic_buffer_resource scratch(options.scratch_upstream);
+    std::vector<Line> lines;
+    parse(lines_raw, lines, &scratch, options.threads);
+    return scan_parsed(lines, machine, options);
+}
+
+FileTaxonomy scan_file(const std::vector<std:: string>& lines_raw, StateMachine& machine) {
+    return scan_raw(lines_raw, machine, {});
+}
+
+FileTaxonomy scan_file(const std::vector<std::string>& lines_raw, StateMachine& machine, const ScanOptions& options) {
+    return scan_raw(lines_raw, machine, options);
+}
+
+FileTaxonomy scan_file(const std::vector<std::string>& lines_raw, const FrozenStateMachine& machine, const ScanOptions& options) {
+    return scan_raw(lines_raw, machine, options);
+}
+
+FileTaxonomy scan_file_parallel(const std::vector<std::string>& lines_raw, StateMachine& machine, size_t threads) {
+    std::pmr::monotonic_buffer_resource scratch;
+    std::vector<Line> lines;
+    parse_parallel(lines_raw, lines, threads, &scratch);
+    return scan_lines_parallel(lines, machine, threads, std::pmr::get_default_resource());
+}
+
+FileTaxonomy scan_source(std::string_view source, StateMachine& machine) {
+    return scan_source(source, machine, {});
+}
+
+template <typename Machine>
+FileTaxonomy scan_lexed(std::string_view source, Machine& machine, const ScanOptions& options) {
+    LexedSource lexed;
+    lex(source, lexed);
+    std::pmr::monotonic_buffer_resource scratch(options.scratch_upstream);
+    std::vector<Line> lines;
+    lines.reserve(lexed.lines.size());
+    for (size_t idx = 0; idx < lexed.lines.size(); idx++) {
+        lines.push_back(materialize(lexed, idx, &scratch));
+    }
+    return scan_parsed(lines, machine, options);
+}
+
+FileTaxonomy scan_source(std::string_view source, StateMachine& machine, const ScanOptions& options) {
+    return scan_lexed(source, machine, options);
+}
+
+FileTaxonomy scan_source(std::string_view source, const FrozenStateMachine& machine, const ScanOptions& options) {
+    return scan_lexed(source, machine, options);
+}
+
+FileTaxonomy scan_path(const std::string& path, StateMachine& machine) {
+    return scan_path(path, machine, {});
+}
+
+template <typename Machine>
+FileTaxonomy scan_mapped(const std::string& path, Machine& machine, const ScanOptions& options) {
+    const MappedFile file(path);
+    if (!file.open()) {
+        return err_file({ unreadable_file() });
+    }
+    return scan_lexed(file.data(), machine, options);
+}
+
+FileTaxonomy scan_path(const std::string& path, StateMachine& machine, const ScanOptions& options) {
+    return scan_mapped(path, machine, options);
+}
+
+FileTaxonomy scan_path(const std::string& path, const FrozenStateMachine& machine, const ScanOptions& options) {
+    return scan_mapped(path, machine, options);
+}
+
+// Opens the block that the current line starts for the last statement of
+// the innermost frame, either its input or one of its branches.
+void open_block(std::vector<ScanFrame>& frames, Indentation& indentation, const IndentationLevel& level) {
+    ScanFrame& frame = frames.back();
+    StatementTaxonomy& stmt = *frame.stmt;
+    if (frame.mode == ScanMode::Lookahead && frame.tax_strat.block_function == BlockFunction::Append) {
+        if (stmt.input.front().empty()) {
+            stmt.input.clear();
         }
-        std::optional<InstructionID> instr_id = machine.find_instr(line.first_word());
-        if (!instr_id.has_value()) {
-            return { unknown_instruction(idx) };
+        frames.push_back({ .block_function = BlockFunction::Append, .owner = &stmt });
+        return;
+    }
+    BranchTaxonomy& branch = frame.mode == ScanMode::Lookahead
+        ? stmt.branch(true, parse(0, ""))
+        : stmt.branch(false, frame.branch_line->crop_from_first_word());
+    indentation.push(frame.indentation, level);
+    frames.push_back({
+        .block_function = BlockFunction::Routine,
+        .indentation = frame.indentation + 1,
+        .routine = &branch.routine,
+        .owner = &stmt,
+        .mode = ScanMode::Statement
+    });
+}
+
+const Symbol END_SYMBOL = Symbol("end");
+
+// Frozen machines look the word up as it is and return the name they
+// interned with the instruction. Machines behind the virtual StateMachine
+// lookup need the word copied into a string, and the name is symbol when
+// the word was interned already.
+template <typename Machine>
+std::optional<NamedInstruction> find_statement(Machine& machine, std::string_view word, const std::optional<Symbol>& symbol) {
+    if constexpr (requires { machine.find_named_instr(word); }) {
+        return machine.find_named_instr(word);
+    } else {
+        const std::optional<InstructionID> id = machine.find_instr(std::string(word));
+        if (!id.has_value()) {
+            return std::nullopt;
         }
-        StatementTaxonomy& stmt = routine.append(instr_id.value(), line);
-        TaxStrat tax_strat = machine.tax_strat(instr_id.value());
+        return NamedInstruction{ .id = id.value(), .name = symbol.has_value() ? symbol.value() : Symbol(word) };
+    }
+}
 
-        if (idx == lines.size() - 1) {
-            continue;
+// Places a line that lies inside the innermost frame.
+template <typename Machine>
+std::optional<CompilationError> scan_line(
+    std::vector<ScanFrame>& frames,
+    Indentation& indentation,
+    const Line& line,
+    std::string_view starting_whitespace,
+    const IndentationLevel& level,
+    Machine& machine
+) {
+    // The first word is only interned once it names an instruction, any
+    // other line may be script data that must not grow the symbol table.
+    // Up to then it is only looked up, a word that was never interned is
+    // neither `end` nor a branch keyword.
+    const std::string_view word = line.first_word();
+    const std::optional<Symbol> symbol = frames.back().block_function == BlockFunction::Append
+        ? std::nullopt
+        : Symbol::find(word);
+    while (true) {
+        ScanFrame& frame = frames.back();
+        if (frame.block_function == BlockFunction::Append) {
+            frame.owner->input.push_back(line.trim(frame.owner->input.get_allocator().resource()));
+            return std::nullopt;
         }
-        const std::string starting_whitespace = lines[idx + 1].starting_whitespace();
-        const IndentationDiff indentation_diff = indentation.diff(starting_whitespace);
-        if (indentation_diff == IndentationDiff::Same) {
+
+        if (frame.mode == ScanMode::Lookahead || frame.mode == ScanMode::BranchBlock) {
+            const IndentationDiff diff = indentation.diff(level, starting_whitespace, frame.indentation);
+            if (diff == IndentationDiff::Error) {
+                return invalid_indentation(line.line_num);
+            }
+            if (frame.mode == ScanMode::Lookahead && diff == IndentationDiff::Same) {
+                frame.mode = ScanMode::Statement;
+                continue;
+            }
+            if (frame.mode == ScanMode::BranchBlock && diff != IndentationDiff::Increase) {
+                // The branch has no block and does not become a branch.
+                frame.mode = ScanMode::Branches;
+                if (diff == IndentationDiff::Same && symbol == END_SYMBOL) {
+                    return std::nullopt;
+                }
+                continue;
+            }
+            if (frame.mode == ScanMode::Lookahead && frame.tax_strat.block_function == BlockFunction::NA) {
+                return instruction_does_not_accept_block(line.line_num);
+            }
+            open_block(frames, indentation, level);
             continue;
         }
-        if (indentation_diff == IndentationDiff::Error) {
-            std::cout << line.raw() << std::endl;
-            return { invalid_indentation(idx + 1) };
-        }
 
-        if (tax_strat.block_function == BlockFunction::NA) {
-            return { instruction_does_not_accept_block(idx + 2) };
+        if (frame.mode == ScanMode::Branches) {
+            const bool stmt_is_branch = symbol.has_value() && std::find(
+                frame.tax_strat.branch_instr.begin(),
+                frame.tax_strat.branch_instr.end(),
+                symbol.value()
+            ) != frame.tax_strat.branch_instr.end();
+            if (stmt_is_branch) {
+                frame.mode = ScanMode::BranchBlock;
+                frame.branch_line = &line;
+                return std::nullopt;
+            }
         }
-        BlockResult result = scan_block(lines, idx + 1, indentation);
-        if (!result.errors.empty()) {
-            return result.errors;
+
+        const std::optional<NamedInstruction> instr = find_statement(machine, word, symbol);
+        if (!instr.has_value()) {
+            return unknown_instruction(line.line_num);
         }
-        idx = result.resume_at;
+        frame.stmt = &frame.routine->append(instr->id, instr->name, line);
+        frame.tax_strat = machine.tax_strat(instr->id);
+        frame.mode = ScanMode::Lookahead;
+        return std::nullopt;
+    }
+}
 
-        if (tax_strat.block_function == BlockFunction::Append) {
-            trim_lines(result.lines);
-            Line first_input = line.crop_from_first_word();
-            if (!first_input.empty()) {
-                result.lines.insert(result.lines.begin(), first_input);
-            }
-            stmt.input = result.lines;
-            continue;
+RoutineScanner::RoutineScanner(RoutineTaxonomy& routine) : is_multi_line_comment(false) {
+    this->frames.push_back({ .block_function = BlockFunction::Routine, .routine = &routine, .mode = ScanMode::Statement });
+}
+
+// Each line first closes the blocks it is not indented into, an `end` at
+// the indentation of a closed block is consumed with it, and is then placed
+// in the innermost block left open.
+template <typename Machine>
+std::optional<CompilationError> RoutineScanner::scan(const Line& line, Machine& machine) {
+    std::vector<ScanFrame>& frames = this->frames;
+    if (skip_line(line, this->is_multi_line_comment)) {
+        return std::nullopt;
+    }
+    const std::string_view starting_whitespace = line.starting_whitespace();
+    const IndentationLevel level(starting_whitespace);
+
+    // A line indented into a block is indented into all blocks around it,
+    // so walk out from the innermost block to the outermost one the line
+    // leaves, which decides whether it is an error or a terminator.
+    size_t open = frames.size();
+    IndentationDiff closing = IndentationDiff::Increase;
+    while (open > 1) {
+        const IndentationDiff diff = this->indentation.diff(level, starting_whitespace, frames[open - 2].indentation);
+        if (diff == IndentationDiff::Increase) {
+            break;
         }
+        closing = diff;
+        open--;
+    }
+    if (closing == IndentationDiff::Error) {
+        return invalid_indentation(line.line_num);
+    }
+    if (open < frames.size()) {
+        const BlockFunction closed = frames[open].block_function;
+        frames.resize(open);
+        frames.back().mode = closed == BlockFunction::Append
+            ? ScanMode::Statement
+            : ScanMode::Branches;
+        if (closing == IndentationDiff::Same && Symbol::find(line.first_word()) == END_SYMBOL) {
+            return std::nullopt;
+        }
+    }
 
-        // We must be in routine
-        BranchTaxonomy& branch = stmt.branch(true, parse(0, ""));
-        Indentation new_indentation = indentation.indent(starting_whitespace);
-        std::vector<CompilationError> errors = scan_routine(result.lines, new_indentation, branch.routine, machine);
-        if (!errors.empty()) {
-            return errors;
+    return scan_line(frames, this->indentation, line, starting_whitespace, level, machine);
+}
+
+// Builds the taxonomy in one walk over the lines.
+template <typename Machine>
+std::vector<CompilationError> scan_routine(const std::vector<Line>& lines, RoutineTaxonomy& routine, std::vector<int>& statement_lines, Machine& machine) {
+    RoutineScanner scanner(routine);
+    for (const Line& line : lines) {
+        const size_t statements = routine.statements.size();
+        std::optional<CompilationError> error = scanner.scan(line, machine);
+        if (error.has_value()) {
+            return { error.value() };
         }
-        BranchResult branch_result = scan_branches(lines, idx, tax_strat, indentation, stmt, machine);
-        if (!branch_result.errors.empty()) {
-            return branch_result.errors;
+        if (routine.statements.size() > statements) {
+            statement_lines.push_back(line.line_num);
         }
-        idx = branch_result.resume_at;
     }
     return {};
 }
 
-BranchResult scan_branches(const std::vector<Line>& lines, size_t from, TaxStrat tax_strat, Indentation& indentation, StatementTaxonomy& stmt, StateMachine& machine) {
-    bool is_multi_line_comment = false;
-    for (size_t idx = from; idx < lines.size() - 1; idx++) {
-        Line next_line = lines[idx + 1];
-        if (skip_line(next_line, is_multi_line_comment)) {
-            continue;
+// Lines [first, last) of a script scanned as if they started the file, into
+// a routine of their own.
+struct ScanSegment {
+    size_t first;
+    size_t last;
+    RoutineTaxonomy routine;
+    std::vector<int> statement_lines;
+    std::optional<RoutineScanner> scanner;
+    std::optional<CompilationError> error;
+};
+
+// Scans lines [from, segment.last) with the scanner of segment.
+template <typename Machine>
+void scan_segment(const std::vector<Line>& lines, size_t from, ScanSegment& segment, Machine& machine) {
+    for (size_t idx = from; idx < segment.last && !segment.error.has_value(); idx++) {
+        const size_t statements = segment.routine.statements.size();
+        segment.error = segment.scanner->scan(lines[idx], machine);
+        if (segment.routine.statements.size() > statements) {
+            segment.statement_lines.push_back(lines[idx].line_num);
         }
-        const bool next_stmt_is_branch = std::find(
-            tax_strat.branch_instr.begin(),
-            tax_strat.branch_instr.end(),
-            next_line.first_word()
-         ) != tax_strat.branch_instr.end();
+    }
+}
 
-        if (!next_stmt_is_branch) {
-            return { .resume_at = idx, .errors = {} };
+// Lines that look like they start a top level statement. Only a guess, a
+// line inside a multi line comment or a branch at the top level looks the
+// same, which the stitching in scan_lines_parallel notices.
+bool maybe_top_level(const Line& line) {
+    return !line.only_whitespace()
+        && line.tokens.front().kind != TokenKind::Whitespace
+        && !line.starts_with_symbol_seq("#")
+        && Symbol::find(line.first_word()) != END_SYMBOL;
+}
+
+std::vector<size_t> segment_starts(const std::vector<Line>& lines, size_t threads) {
+    const size_t count = std::max<size_t>(1, std::min(threads * 4, lines.size() / SCAN_SEGMENT_MIN_LINES));
+    std::vector<size_t> starts = { 0 };
+    for (size_t segment = 1; segment < count; segment++) {
+        size_t idx = std::max(starts.back() + 1, lines.size() * segment / count);
+        while (idx < lines.size() && !maybe_top_level(lines[idx])) {
+            idx++;
+        }
+        if (idx >= lines.size()) {
+            break;
         }
+        starts.push_back(idx);
+    }
+    return starts;
+}
+
+// Scans segments of the script at once, each from a fresh scanner. A
+// segment was scanned right when the scan of everything before it takes
+// its first line for a top level statement, since the state after that
+// line does not depend on anything before it. Otherwise the segment is
+// scanned again carrying on from the segment before. Errors are only
+// taken from segments known to be right, so the first error in the file
+// is the one reported.
+template <typename Machine>
+FileTaxonomy scan_lines_parallel(const std::vector<Line>& lines, Machine& machine, size_t threads, std::pmr::memory_resource* upstream) {
+    const std::vector<size_t> starts = segment_starts(lines, threads);
+    // The taxonomy keeps the arenas of all segments alive through the first.
+    std::shared_ptr<std::deque<std::pmr::monotonic_buffer_resource>> arenas =
+        std::make_shared<std::deque<std::pmr::monotonic_buffer_resource>>();
+    std::vector<ScanSegment> segments;
+    segments.reserve(starts.size());
+    for (size_t idx = 0; idx < starts.size(); idx++) {
+        arenas->emplace_back(upstream);
+        segments.push_back({
+            .first = starts[idx],
+            .last = idx + 1 < starts.size() ? starts[idx + 1] : lines.size(),
+            .routine = { .statements = std::pmr::vector<StatementTaxonomy>(&(*arenas)[idx]) }
+        });
+    }
+
+    ThreadPool pool = ThreadPool(std::max<size_t>(1, std::min(threads, segments.size())));
+    pool.run(segments.size(), [&](size_t idx) {
+        ScanSegment& segment = segments[idx];
+        segment.scanner.emplace(segment.routine);
+        scan_segment(lines, segment.first, segment, machine);
+    });
 
-        BlockResult result = scan_block(lines, idx + 2, indentation);
-        if (!result.errors.empty()) {
-            return { .resume_at = lines.size(), .errors = result.errors };
+    std::vector<size_t> kept = { 0 };
+    for (size_t idx = 1; idx < segments.size(); idx++) {
+        ScanSegment& current = segments[kept.back()];
+        if (current.error.has_value()) {
+            break;
         }
-        idx = result.resume_at;
-        if (result.lines.empty()) {
+        const Line& first = lines[segments[idx].first];
+        const size_t statements = current.routine.statements.size();
+        current.error = current.scanner->scan(first, machine);
+        if (current.error.has_value()) {
+            break;
+        }
+        if (current.routine.statements.size() > statements) {
+            current.routine.statements.pop_back();
+            kept.push_back(idx);
             continue;
         }
+        current.last = segments[idx].last;
+        scan_segment(lines, segments[idx].first + 1, current, machine);
+    }
+    const ScanSegment& last = segments[kept.back()];
+    if (last.error.has_value()) {
+        return err_file({ last.error.value() });
+    }
+
+    FileTaxonomy file = {
+        .arena = std::shared_ptr<std::pmr::monotonic_buffer_resource>(arenas, &arenas->front()),
+        .routine = { .statements = std::pmr::vector<StatementTaxonomy>(&arenas->front()) }
+    };
+    size_t statements = 0;
+    for (size_t idx : kept) {
+        statements += segments[idx].routine.statements.size();
+    }
+    file.routine.statements.reserve(statements);
+    file.statement_lines.reserve(statements);
+    for (size_t idx : kept) {
+        ScanSegment& segment = segments[idx];
+        std::move(segment.routine.statements.begin(), segment.routine.statements.end(), std::back_inserter(file.routine.statements));
+        file.statement_lines.insert(file.statement_lines.end(), segment.statement_lines.begin(), segment.statement_lines.end());
+    }
+    return file;
+}
 
-        BranchTaxonomy& branch = stmt.branch(false, next_line.crop_from_first_word());
-        Indentation new_indentation = indentation.indent(result.lines[0].starting_whitespace());
-        std::vector<CompilationError> errors = scan_routine(result.lines, new_indentation, branch.routine, machine);
-        if (!errors.empty()) {
-            return { .resume_at = lines.size(), .errors = errors };
+void shift_lines(RoutineTaxonomy& routine, int delta);
+
+void shift_lines(StatementTaxonomy& stmt, int delta) {
+    for (Line& line : stmt.input) {
+        line.line_num += delta;
+    }
+    for (BranchTaxonomy& branch : stmt.branches) {
+        // Default branches have no line of their own.
+        if (!branch.default_branch) {
+            branch.input.line_num += delta;
         }
+        shift_lines(branch.routine, delta);
+    }
+}
+
+void shift_lines(RoutineTaxonomy& routine, int delta) {
+    for (StatementTaxonomy& stmt : routine.statements) {
+        shift_lines(stmt, delta);
+    }
+}
+
+// Replaces the rows [first, last) of rows with the rows of replacement.
+template <typename Rows, typename Replacement>
+void splice_rows(Rows& rows, size_t first, size_t last, Replacement& replacement) {
+    const size_t common = std::min(replacement.size(), last - first);
+    std::move(replacement.begin(), replacement.begin() + common, rows.begin() + first);
+    if (replacement.size() > common) {
+        rows.insert(
+            rows.begin() + first + common,
+            std::make_move_iterator(replacement.begin() + common),
+            std::make_move_iterator(replacement.end())
+        );
+    } else {
+        rows.erase(rows.begin() + first + common, rows.begin() + last);
     }
-    return { .resume_at = lines.size(), .errors = {} };
 }
 
-BlockResult scan_block(const std::vector<Line>& lines, size_t starting_from, const Indentation& indentation) {
-    std::vector<Line> block;
-    bool is_multi_line_comment = false;
-    for (size_t idx = starting_from; idx < lines.size(); idx++) {
-        const Line line = lines[idx];
-        if (skip_line(line, is_multi_line_comment)) {
+// The text before the header of a statement decides nothing about it but
+// whether it is one, so the scan restarts at the last header before the
+// edits. It stops at the first header after them that the new scan also
+// takes for a statement, from there on both scans are in the same state.
+FileTaxonomy rescan_file(FileTaxonomy previous, const std::vector<std::string>& lines, const std::vector<LineEdit>& edits, StateMachine& machine) {
+    std::pmr::vector<StatementTaxonomy>& statements = previous.routine.statements;
+    const std::vector<int>& starts = previous.statement_lines;
+    if (!previous.errors.empty() || starts.size() != statements.size()) {
+        return scan_file(lines, machine);
+    }
+    if (edits.empty()) {
+        return previous;
+    }
+    int edit_first = INT_MAX;
+    int edit_end = 0;
+    int delta = 0;
+    for (const LineEdit& edit : edits) {
+        edit_first = std::min(edit_first, edit.first_line);
+        edit_end = std::max(edit_end, edit.first_line + edit.removed);
+        delta += edit.inserted - edit.removed;
+    }
+
+    const size_t before = std::lower_bound(starts.begin(), starts.end(), edit_first) - starts.begin();
+    const size_t first = before == 0 ? 0 : before - 1;
+    size_t last = std::lower_bound(starts.begin(), starts.end(), edit_end) - starts.begin();
+    const int first_line = before == 0 ? 1 : starts[first];
+
+    std::pmr::monotonic_buffer_resource scratch;
+    RoutineTaxonomy scanned = { .statements = std::pmr::vector<StatementTaxonomy>(statements.get_allocator().resource()) };
+    std::vector<int> scanned_lines;
+    std::vector<Line> parsed;
+    parsed.reserve(lines.size() - std::min<size_t>(lines.size(), first_line - 1));
+    std::vector<TokenView> tokens;
+    RoutineScanner scanner(scanned);
+    bool in_step = false;
+    for (int line_num = first_line; line_num <= int(lines.size()) && !in_step; line_num++) {
+        const std::string& text = lines[line_num - 1];
+        tokens.clear();
+        lex_line(text, tokens);
+        parsed.push_back(materialize(line_num, text, tokens.data(), tokens.size(), &scratch));
+
+        const size_t count = scanned.statements.size();
+        std::optional<CompilationError> error = scanner.scan(parsed.back(), machine);
+        if (error.has_value()) {
+            return err_file({ error.value() });
+        }
+        if (scanned.statements.size() == count) {
             continue;
         }
-        const IndentationDiff diff = indentation.diff(line.starting_whitespace());
-        if (diff == IndentationDiff::Error) {
-            return { .lines = block, .resume_at = idx - 1, .errors = { invalid_indentation(idx + 1) } };
+        while (last < starts.size() && starts[last] + delta < line_num) {
+            last++;
         }
-        if (diff == IndentationDiff::Increase) {
-            block.push_back(line);
-            continue;
+        in_step = last < starts.size() && starts[last] + delta == line_num;
+        if (in_step) {
+            scanned.statements.pop_back();
+        } else {
+            scanned_lines.push_back(line_num);
         }
-        if (diff == IndentationDiff::Decrease || line.first_word() != "end") {
-            return { .lines = block, .resume_at = idx - 1 };
+    }
+    if (!in_step) {
+        last = starts.size();
+    }
+
+    splice_rows(statements, first, last, scanned.statements);
+    splice_rows(previous.statement_lines, first, last, scanned_lines);
+    if (delta != 0) {
+        for (size_t idx = first + scanned_lines.size(); idx < statements.size(); idx++) {
+            shift_lines(statements[idx], delta);
+            previous.statement_lines[idx] += delta;
         }
-        return { .lines = block, .resume_at = idx };
     }
-    return { .lines = block, .resume_at = lines.size() };
+    return previous;
 }
 
 bool skip_line(const Line& line, bool& is_multi_line_comment) {
@@ -190,9 +612,3 @@ bool skip_line(const Line& line, bool& is_multi_line_comment) {
     }
     return false;
 }
-
-void trim_lines(std::vector<Line>& lines) {
-    for (int idx = 0; idx < lines.size(); idx++) {
-        lines[idx] = lines[idx].trim();
-    }
-}
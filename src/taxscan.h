@@ -2,21 +2,83 @@
 #define LK_TAXSCAN
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <memory_resource>
 
 #include "errors.h"
 #include "core_types.h"
 #include "state_machine.h"
 
 struct FileTaxonomy {
+	// Owns the storage of every node in routine and is released with the
+	// last copy of the taxonomy. Declared first so it is destroyed last.
+	std::shared_ptr<std::pmr::monotonic_buffer_resource> arena;
 	RoutineTaxonomy routine;
 	std::vector<CompilationError> errors;
+	// Line number of the first line of each statement in routine, which
+	// rescan_file uses to find the statements an edit touched. It follows
+	// from routine and is not compared.
+	std::vector<int> statement_lines;
 
 	bool operator==(const FileTaxonomy& other) const;
 	friend std::ostream& operator<<(std::ostream& os, const FileTaxonomy& line);
 };
 
+// Scripts with at least this many lines are scanned on every hardware
+// thread when the machine allows concurrent lookups.
+const size_t PARALLEL_SCAN_MIN_LINES = 16384;
+// Fewest lines scanned by one pool task of a parallel scan.
+const size_t SCAN_SEGMENT_MIN_LINES = 1024;
+
+// Where a scan gets its memory and threads from.
+struct ScanOptions {
+	// Threads a large script may be scanned on, 0 for every hardware thread.
+	size_t threads = 0;
+	// Upstream of the arena the parsed lines live in during the scan.
+	std::pmr::memory_resource* scratch_upstream = std::pmr::get_default_resource();
+	// Upstream of the arena of the returned taxonomy, must outlive it.
+	std::pmr::memory_resource* arena_upstream = std::pmr::get_default_resource();
+};
+
 FileTaxonomy scan_file(const std::vector<std:: string>& lines, StateMachine& machine);
+// options.threads caps the threads of both the parse and the scan.
+FileTaxonomy scan_file(const std::vector<std::string>& lines, StateMachine& machine, const ScanOptions& options);
+// Scans against a frozen machine call its lookups directly instead of
+// through StateMachine, so they can be inlined into the scan.
+FileTaxonomy scan_file(const std::vector<std::string>& lines, const FrozenStateMachine& machine, const ScanOptions& options = {});
+// Same taxonomy as scan_file, with the script split at top level statements
+// into segments that are scanned on up to threads threads. The machine must
+// allow concurrent lookups.
+FileTaxonomy scan_file_parallel(const std::vector<std::string>& lines, StateMachine& machine, size_t threads);
+FileTaxonomy scan_source(std::string_view source, StateMachine& machine);
+FileTaxonomy scan_source(std::string_view source, StateMachine& machine, const ScanOptions& options);
+FileTaxonomy scan_source(std::string_view source, const FrozenStateMachine& machine, const ScanOptions& options = {});
+// Memory maps the script at path instead of reading it into strings.
+FileTaxonomy scan_path(const std::string& path, StateMachine& machine);
+FileTaxonomy scan_path(const std::string& path, StateMachine& machine, const ScanOptions& options);
+FileTaxonomy scan_path(const std::string& path, const FrozenStateMachine& machine, const ScanOptions& options = {});
+// Scans lines the caller parsed, which must outlive the scan.
+FileTaxonomy scan_lines(const std::vector<Line>& lines, StateMachine& machine, const ScanOptions& options = {});
+FileTaxonomy scan_lines(const std::vector<Line>& lines, const FrozenStateMachine& machine, const ScanOptions& options = {});
 FileTaxonomy empty_file_taxonomy();
+// Empty taxonomy whose nodes are allocated from its own arena.
+FileTaxonomy arena_file_taxonomy(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+// Lines [first_line, first_line + removed) of the previous source, by line
+// number, were replaced by inserted lines.
+struct LineEdit {
+	int first_line;
+	int removed;
+	int inserted;
+};
+
+// Scans lines, the previous source with edits applied, reusing every
+// statement of previous that the edits can not have changed. Only the
+// statements around the range covering all edits are lexed and scanned
+// again, the rest are moved over and renumbered. The replaced statements
+// keep their space in the arena until the taxonomy is released.
+FileTaxonomy rescan_file(FileTaxonomy previous, const std::vector<std::string>& lines, const std::vector<LineEdit>& edits, StateMachine& machine);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,393 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include "bench.h"
+#include "taxscan.h"
+#include "flat_taxonomy.h"
+#include "taxonomy_cache.h"
+#include "batch.h"
+
+namespace fs = std::filesystem;
+
+const InstructionID BENCH_INSTR_IF = 1;
+const InstructionID BENCH_INSTR_COMMAND = 2;
+
+class BenchStateMachine: public StateMachine {
+    private:
+    const TaxStrat if_strat = branch_strat({"else"});
+
+    public:
+    std::optional<InstructionID> find_instr(const std::string& name) {
+        if (name == "if") {
+            return BENCH_INSTR_IF;
+        }
+        if (name == "print" || name == "var" || name == "curl" || name == "exit") {
+            return BENCH_INSTR_COMMAND;
+        }
+        return std::nullopt;
+    }
+
+    TaxStrat tax_strat(InstructionID instr) {
+        if (instr == BENCH_INSTR_IF) {
+            return this->if_strat;
+        }
+        return command_strat();
+    }
+
+    // The instruction table above never changes.
+    std::optional<uint64_t> fingerprint() {
+        return 1;
+    }
+
+    bool concurrent_lookups() {
+        return true;
+    }
+};
+
+const std::string& bench_script_path() {
+    static const std::string path = []() {
+        const fs::path file = fs::temp_directory_path() / "lorikeet_bench_50k.lk";
+        std::ofstream out(file);
+        for (const std::string& line : generated_script(50000)) {
+            out << line << "\n";
+        }
+        return file.string();
+    }();
+    return path;
+}
+
+int scan_file_bench = register_bench("TaxScan/ReadLinesAndScanFile/50k", [](BenchState& state) {
+    const std::string& path = bench_script_path();
+    BenchStateMachine machine;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        std::ifstream in(path);
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(in, line)) {
+            lines.push_back(line);
+        }
+        keep(scan_file(lines, machine));
+    }
+    state.bytes = fs::file_size(path);
+});
+
+int scan_path_bench = register_bench("TaxScan/ScanPath/50k", [](BenchState& state) {
+    const std::string& path = bench_script_path();
+    BenchStateMachine machine;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(scan_path(path, machine));
+    }
+    state.bytes = fs::file_size(path);
+});
+
+int scan_path_cached_bench = register_bench("TaxScan/ScanPathCached/50k", [](BenchState& state) {
+    const std::string& path = bench_script_path();
+    const std::string cache_file = (fs::temp_directory_path() / "lorikeet_bench_50k.taxonomy").string();
+    BenchStateMachine machine;
+    fs::remove(cache_file);
+    keep(scan_path_cached(path, machine, cache_file));
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(scan_path_cached(path, machine, cache_file));
+    }
+    state.bytes = fs::file_size(path);
+});
+
+int scan_file_100k_bench = register_bench("TaxScan/ScanFile/100k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(100000);
+    BenchStateMachine machine;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(scan_file(script, machine));
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/scan", double(allocations() - allocs_before) / state.iterations);
+    state.counter("peak_rss_mb", peak_rss_mb());
+});
+
+// One character of a line in the middle of the script changes back and
+// forth, every rescan starts from the taxonomy of the last one.
+int rescan_edit_bench = register_bench("TaxScan/RescanOneCharEdit/20k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(20000);
+    std::vector<std::string> edited = script;
+    edited[9999][7] = 'L';
+    BenchStateMachine machine;
+    FileTaxonomy taxonomy = scan_file(script, machine);
+    const std::vector<LineEdit> edits = {{ .first_line = 10000, .removed = 1, .inserted = 1 }};
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        taxonomy = rescan_file(std::move(taxonomy), iter % 2 == 0 ? edited : script, edits, machine);
+    }
+    keep(taxonomy);
+});
+
+// Inserting a line renumbers every statement after it.
+int rescan_insert_bench = register_bench("TaxScan/RescanInsertLine/20k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(20000);
+    std::vector<std::string> inserted = script;
+    inserted.insert(inserted.begin() + 9999, "print 'inserted'");
+    BenchStateMachine machine;
+    FileTaxonomy taxonomy = scan_file(script, machine);
+    const std::vector<LineEdit> insert = {{ .first_line = 10000, .removed = 0, .inserted = 1 }};
+    const std::vector<LineEdit> remove = {{ .first_line = 10000, .removed = 1, .inserted = 0 }};
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        taxonomy = iter % 2 == 0
+            ? rescan_file(std::move(taxonomy), inserted, insert, machine)
+            : rescan_file(std::move(taxonomy), script, remove, machine);
+    }
+    keep(taxonomy);
+});
+
+int scan_file_20k_bench = register_bench("TaxScan/ScanFile/20k", [](BenchState& state) {
+    const std::vector<std::string> script = generated_script(20000);
+    BenchStateMachine machine;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(scan_file(script, machine));
+    }
+    state.bytes = script_bytes(script);
+});
+
+// Commands, every fourth with an indented block of input, scanned from
+// lines parsed up front so only the per statement cost is measured.
+std::vector<std::string> command_script(size_t count) {
+    std::vector<std::string> script;
+    script.reserve(count);
+    for (size_t idx = 0; script.size() < count; idx++) {
+        script.push_back("cmd" + std::to_string(idx % 64) + " 'arg' --flag $var");
+        if (idx % 4 == 0) {
+            script.push_back("    data " + std::to_string(idx));
+        }
+    }
+    return script;
+}
+
+FrozenStateMachine bench_frozen_machine() {
+    std::vector<CommandInstr> commands;
+    for (InstructionID id = 0; id < 64; id++) {
+        commands.push_back({ .id = id + 1, .name = "cmd" + std::to_string(id), .path = "/bench/cmd" + std::to_string(id) });
+    }
+    return FrozenStateMachine(std::make_shared<const InstructionTable>(commands));
+}
+
+void run_scan_lines_bench(BenchState& state, const FrozenStateMachine& frozen, bool virtual_lookups) {
+    const std::vector<std::string> script = command_script(100000);
+    std::pmr::monotonic_buffer_resource scratch;
+    std::vector<Line> lines;
+    parse(script, lines, &scratch);
+    FrozenStateMachine machine = frozen;
+    StateMachine& dynamic = machine;
+    size_t statements = 0;
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        const FileTaxonomy file = virtual_lookups
+            ? scan_lines(lines, dynamic, { .threads = 1 })
+            : scan_lines(lines, frozen, { .threads = 1 });
+        statements = file.routine.statements.size();
+        keep(file);
+    }
+    state.items = statements;
+}
+
+int scan_lines_virtual_bench = register_bench("TaxScan/ScanLines/100k/VirtualLookups", [](BenchState& state) {
+    run_scan_lines_bench(state, bench_frozen_machine(), true);
+});
+
+int scan_lines_frozen_bench = register_bench("TaxScan/ScanLines/100k/FrozenLookups", [](BenchState& state) {
+    run_scan_lines_bench(state, bench_frozen_machine(), false);
+});
+
+// Every block nests one level deeper than the last, so scanning cost grows
+// with depth if blocks are copied before being rescanned.
+int scan_nested_bench = register_bench("TaxScan/ScanFile/Nested", [](BenchState& state) {
+    std::vector<std::string> script;
+    for (size_t repeat = 0; repeat < 50; repeat++) {
+        for (size_t depth = 0; depth < 200; depth++) {
+            script.push_back(std::string(depth * 4, ' ') + "if $depth");
+            script.push_back(std::string(depth * 4 + 4, ' ') + "print \"level\"");
+        }
+    }
+    BenchStateMachine machine;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(scan_file(script, machine));
+    }
+    state.bytes = script_bytes(script);
+    state.counter("allocs/scan", double(allocations() - allocs_before) / state.iterations);
+});
+
+// Ladders of blocks that climb to depth and back to the top level.
+std::vector<std::string> nested_script(size_t count, size_t depth) {
+    std::vector<std::string> script;
+    script.reserve(count);
+    while (script.size() < count) {
+        for (size_t level = 0; level < depth && script.size() < count; level++) {
+            script.push_back(std::string(level * 4, ' ') + "if $level");
+            script.push_back(std::string(level * 4 + 4, ' ') + "print \"level\"");
+        }
+    }
+    return script;
+}
+
+// Scan time per item (line) should stay flat as the script grows at a fixed depth.
+void register_nested_scaling_bench(size_t count) {
+    register_bench("TaxScan/Depth50/" + std::to_string(count / 1000) + "k", [count](BenchState& state) {
+        const std::vector<std::string> script = nested_script(count, 50);
+        BenchStateMachine machine;
+
+        state.start();
+        for (size_t iter = 0; iter < state.iterations; iter++) {
+            keep(scan_file(script, machine));
+        }
+        state.items = script.size();
+    });
+}
+
+int nested_scaling_benches = []() {
+    for (size_t count : {25000, 50000, 100000, 200000}) {
+        register_nested_scaling_bench(count);
+    }
+    return 0;
+}();
+
+// The generated script is made of short top level statements, like the
+// provisioning scripts that motivated splitting scans into segments.
+void register_parallel_scan_bench(size_t threads) {
+    register_bench("TaxScan/ScanFileParallel/200k/" + std::to_string(threads) + "threads", [threads](BenchState& state) {
+        const std::vector<std::string> script = generated_script(200000);
+        BenchStateMachine machine;
+
+        state.start();
+        for (size_t iter = 0; iter < state.iterations; iter++) {
+            keep(scan_file_parallel(script, machine, threads));
+        }
+        state.bytes = script_bytes(script);
+        state.items = script.size();
+    });
+}
+
+int parallel_scan_benches = []() {
+    for (size_t threads : {1, 2, 4, 8, 16}) {
+        register_parallel_scan_bench(threads);
+    }
+    return 0;
+}();
+
+const std::vector<std::string>& bench_batch_paths() {
+    static const std::vector<std::string> paths = []() {
+        const fs::path dir = fs::temp_directory_path() / "lorikeet_bench_batch";
+        fs::create_directories(dir);
+        std::vector<std::string> paths;
+        for (size_t idx = 0; idx < 500; idx++) {
+            const fs::path file = dir / ("script" + std::to_string(idx) + ".lk");
+            std::ofstream out(file);
+            for (const std::string& line : generated_script(200 + (idx * 37) % 800)) {
+                out << line << "\n";
+            }
+            paths.push_back(file.string());
+        }
+        return paths;
+    }();
+    return paths;
+}
+
+int scan_paths_bench = register_bench("Batch/ScanPathLoop/500files", [](BenchState& state) {
+    const std::vector<std::string>& paths = bench_batch_paths();
+    BenchStateMachine machine;
+
+    state.start();
+    const size_t allocs_before = allocations();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        for (const std::string& path : paths) {
+            keep(scan_path(path, machine).errors);
+        }
+    }
+    state.items = paths.size();
+    state.counter("allocs/file", double(allocations() - allocs_before) / state.iterations / paths.size());
+});
+
+void register_batch_bench(size_t threads) {
+    register_bench("Batch/CompileBatch/500files/" + std::to_string(threads) + "threads", [threads](BenchState& state) {
+        const std::vector<std::string>& paths = bench_batch_paths();
+        BenchStateMachine machine;
+
+        state.start();
+        const size_t allocs_before = allocations();
+        for (size_t iter = 0; iter < state.iterations; iter++) {
+            keep(compile_batch(paths, machine, { .threads = threads }).failed_files);
+        }
+        state.items = paths.size();
+        state.counter("allocs/file", double(allocations() - allocs_before) / state.iterations / paths.size());
+    });
+}
+
+int batch_benches = []() {
+    for (size_t threads : {1, 4, 16}) {
+        register_batch_bench(threads);
+    }
+    return 0;
+}();
+
+size_t count_tokens(const RoutineTaxonomy& routine) {
+    size_t count = 0;
+    for (const StatementTaxonomy& stmt : routine.statements) {
+        for (const Line& line : stmt.input) {
+            count += line.tokens.size();
+        }
+        for (const BranchTaxonomy& branch : stmt.branches) {
+            count += branch.input.tokens.size() + count_tokens(branch.routine);
+        }
+    }
+    return count;
+}
+
+size_t count_tokens(const FlatTaxonomy& flat, FlatRange routine) {
+    size_t count = 0;
+    for (const FlatStatement& stmt : flat.statements_in(routine)) {
+        for (const FlatLine& line : flat.lines_in(stmt.input)) {
+            count += line.tokens.count;
+        }
+        for (const FlatBranch& branch : flat.branches_in(stmt.branches)) {
+            count += flat.lines[branch.input].tokens.count + count_tokens(flat, branch.routine);
+        }
+    }
+    return count;
+}
+
+int traverse_tree_bench = register_bench("Taxonomy/TraverseTree/100k", [](BenchState& state) {
+    BenchStateMachine machine;
+    const FileTaxonomy file = scan_file(generated_script(100000), machine);
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(count_tokens(file.routine));
+    }
+    state.items = 100000;
+});
+
+int traverse_flat_bench = register_bench("Taxonomy/TraverseFlat/100k", [](BenchState& state) {
+    BenchStateMachine machine;
+    const FlatTaxonomy flat = flatten(scan_file(generated_script(100000), machine));
+
+    state.start();
+    for (size_t iter = 0; iter < state.iterations; iter++) {
+        keep(count_tokens(flat, flat.routine));
+    }
+    state.items = 100000;
+});
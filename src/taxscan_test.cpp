@@ -2,7 +2,10 @@
 #include <vector>
 #include <string>
 #include <optional>
+#include <fstream>
+#include <random>
 #include "taxscan.h"
+#include "test_util.h"
 
 const InstructionID INSTR_ID_NOOP     = 1;
 const InstructionID INSTR_ID_IF       = 2;
@@ -1156,3 +1159,526 @@ TEST(TaxScan, ScanAppendWithinSubroutine) {
 
 	EXPECT_EQ(actual, expected);
 }
+
+
+TEST(TaxScan, ScanStatementAfterBranches) {
+	std::vector<std::string> lines = {
+		"if true",
+		"	print 'A'",
+		"else",
+		"	print 'B'",
+		"print 'C'"
+	};
+
+	FileTaxonomy actual = scan_file(lines, machine);
+
+	FileTaxonomy expected = {
+		.routine = {
+			.statements = {
+				{
+					.name =  "if",
+					.input = {parse(1, " true")},
+					.instr_id = INSTR_ID_IF,
+					.branches = {
+						{
+							.default_branch = true,
+							.input =         parse(0, ""),
+							.routine = {
+								.statements = {
+									{
+										.name =     "print",
+										.input =    {parse(2, " 'A'")},
+										.instr_id = INSTR_ID_PRINT,
+										.branches = {}
+									}
+								}
+							}
+						},
+						{
+							.default_branch = false,
+							.input =         parse(3, ""),
+							.routine = {
+								.statements = {
+									{
+										.name =     "print",
+										.input =    {parse(4, " 'B'")},
+										.instr_id = INSTR_ID_PRINT,
+										.branches = {}
+									}
+								}
+							}
+						}
+					}
+				},
+				{
+					.name =     "print",
+					.input =    {parse(5, " 'C'")},
+					.instr_id = INSTR_ID_PRINT,
+					.branches = {}
+				}
+			}
+		}
+	};
+
+	EXPECT_EQ(actual, expected);
+}
+
+
+TEST(TaxScan, NestedErrorsReportFileLineNumbers) {
+	std::vector<std::string> lines = {
+		"print 'A'",
+		"if true",
+		"",
+		"	print 'B'",
+		"	missing 'C'"
+	};
+
+	FileTaxonomy expected = {
+		.errors = {
+			unknown_instruction(5)
+		}
+	};
+
+	EXPECT_EQ(scan_file(lines, machine), expected);
+}
+
+
+TEST(TaxScan, ScanSourceFindsLinesItself) {
+	std::vector<std::string> lines = {
+		"print 'Hello'",
+		"if true",
+		"	print 'World'",
+		"else",
+		"   print 'Bye'"
+	};
+	std::string source;
+	for (const std::string& line : lines) {
+		source += line + "\n";
+	}
+
+	EXPECT_EQ(scan_source(source, machine), scan_file(lines, machine));
+}
+
+
+TEST(TaxScan, ScanPathMapsFile) {
+	const std::string path = temp_test_file("scan_path.lk");
+	std::ofstream(path) << "print 'Hello'\nhexdump\n\t00 01\nend\n";
+
+	FileTaxonomy expected = scan_file({"print 'Hello'", "hexdump", "\t00 01", "end"}, machine);
+
+	EXPECT_EQ(scan_path(path, machine), expected);
+}
+
+
+TEST(TaxScan, ScanPathReportsUnreadableFile) {
+	FileTaxonomy expected = {
+		.errors = {
+			unreadable_file()
+		}
+	};
+
+	EXPECT_EQ(scan_path("/does/not/exist.lk", machine), expected);
+}
+
+
+TEST(TaxScan, ScanRecordsStatementLines) {
+	std::vector<std::string> lines = {
+		"# comment",
+		"print 'A'",
+		"if true",
+		"	print 'B'",
+		"else",
+		"	print 'C'",
+		"",
+		"hexdump",
+		"	00 01",
+		"end",
+		"print 'D'"
+	};
+
+	EXPECT_EQ(scan_file(lines, machine).statement_lines, std::vector<int>({ 2, 3, 8, 11 }));
+}
+
+
+void expect_rescan_matches_scan(const std::vector<std::string>& before, const std::vector<std::string>& after, const std::vector<LineEdit>& edits) {
+	const FileTaxonomy expected = scan_file(after, machine);
+	const FileTaxonomy rescanned = rescan_file(scan_file(before, machine), after, edits, machine);
+
+	EXPECT_EQ(rescanned, expected);
+	EXPECT_EQ(rescanned.statement_lines, expected.statement_lines);
+}
+
+
+const std::vector<std::string> RESCAN_SCRIPT = {
+	"print 'A'",
+	"if true",
+	"	print 'B'",
+	"else",
+	"	print 'C'",
+	"hexdump",
+	"	00 01",
+	"end",
+	"print 'D'",
+	"print 'E'"
+};
+
+
+TEST(TaxScan, RescanEditedLine) {
+	std::vector<std::string> after = RESCAN_SCRIPT;
+	after[2] = "	print 'b'";
+
+	expect_rescan_matches_scan(RESCAN_SCRIPT, after, {{ .first_line = 3, .removed = 1, .inserted = 1 }});
+}
+
+
+TEST(TaxScan, RescanRenumbersLaterStatements) {
+	std::vector<std::string> after = RESCAN_SCRIPT;
+	after.insert(after.begin() + 1, { "print 'X'", "", "print 'Y'" });
+	after.erase(after.begin() + 9);
+
+	expect_rescan_matches_scan(RESCAN_SCRIPT, after, {
+		{ .first_line = 2, .removed = 0, .inserted = 3 },
+		{ .first_line = 7, .removed = 1, .inserted = 0 }
+	});
+}
+
+
+TEST(TaxScan, RescanFollowsChangedBlocks) {
+	// The edited statement swallows the block after it, so the scan only
+	// gets back in step with the previous one further down.
+	std::vector<std::string> after = RESCAN_SCRIPT;
+	after[0] = "if false";
+	after[5] = "	hexdump";
+	after[7] = "	end";
+
+	expect_rescan_matches_scan(RESCAN_SCRIPT, after, {
+		{ .first_line = 1, .removed = 1, .inserted = 1 },
+		{ .first_line = 6, .removed = 1, .inserted = 1 },
+		{ .first_line = 8, .removed = 1, .inserted = 1 }
+	});
+}
+
+
+TEST(TaxScan, RescanReportsErrors) {
+	std::vector<std::string> after = RESCAN_SCRIPT;
+	after[8] = "missing 'D'";
+
+	const FileTaxonomy rescanned = rescan_file(scan_file(RESCAN_SCRIPT, machine), after, {{ .first_line = 9, .removed = 1, .inserted = 1 }}, machine);
+
+	EXPECT_EQ(rescanned, scan_file(after, machine));
+	EXPECT_EQ(rescanned.errors, std::vector<CompilationError>({ unknown_instruction(9) }));
+}
+
+
+TEST(TaxScan, RescanAfterErrorsScansEverything) {
+	std::vector<std::string> before = RESCAN_SCRIPT;
+	before[8] = "missing 'D'";
+
+	expect_rescan_matches_scan(before, RESCAN_SCRIPT, {{ .first_line = 9, .removed = 1, .inserted = 1 }});
+}
+
+
+class LookupCountingMachine: public TestStateMachine {
+	public:
+	size_t lookups = 0;
+
+	std::optional<InstructionID> find_instr(const std::string& name) {
+		this->lookups++;
+		return TestStateMachine::find_instr(name);
+	}
+};
+
+
+TEST(TaxScan, RescanOnlyScansTouchedStatements) {
+	LookupCountingMachine counting;
+	std::vector<std::string> before;
+	for (int idx = 0; idx < 100; idx++) {
+		before.push_back("print " + std::to_string(idx));
+	}
+	std::vector<std::string> after = before;
+	after[49] = "print 'changed'";
+	FileTaxonomy previous = scan_file(before, counting);
+	counting.lookups = 0;
+
+	const FileTaxonomy rescanned = rescan_file(std::move(previous), after, {{ .first_line = 50, .removed = 1, .inserted = 1 }}, counting);
+
+	EXPECT_EQ(rescanned, scan_file(after, machine));
+	EXPECT_LE(counting.lookups, 3);
+}
+
+
+class ConcurrentTestStateMachine: public TestStateMachine {
+	public:
+	bool concurrent_lookups() {
+		return true;
+	}
+};
+
+
+// Long enough to be split into several segments, with lines that look like
+// top level statements but are not, around every likely segment start.
+std::vector<std::string> segmented_script(size_t count) {
+	std::vector<std::string> lines;
+	for (size_t block = 0; lines.size() < count; block++) {
+		const std::string num = std::to_string(block);
+		const std::vector<std::string> statements = {
+			"print 'line " + num + "'",
+			"if true",
+			"	print 'then'",
+			"else",
+			"	print 'else'",
+			"hexdump",
+			"	00 01",
+			"end",
+			"#<",
+			"print 'commented " + num + "'",
+			">#",
+			"if false",
+			"	hexdump",
+			"		02 03",
+			"	end",
+			"end"
+		};
+		lines.insert(lines.end(), statements.begin(), statements.end());
+	}
+	return lines;
+}
+
+
+TEST(TaxScan, ScanFileParallelMatchesScanFile) {
+	ConcurrentTestStateMachine concurrent;
+	const std::vector<std::string> lines = segmented_script(SCAN_SEGMENT_MIN_LINES * 8);
+
+	const FileTaxonomy expected = scan_file(lines, machine);
+	const FileTaxonomy actual = scan_file_parallel(lines, concurrent, 4);
+
+	ASSERT_TRUE(expected.errors.empty());
+	EXPECT_EQ(actual, expected);
+	EXPECT_EQ(actual.statement_lines, expected.statement_lines);
+}
+
+
+TEST(TaxScan, ScanFileParallelReportsFirstError) {
+	ConcurrentTestStateMachine concurrent;
+	std::vector<std::string> lines = segmented_script(SCAN_SEGMENT_MIN_LINES * 8);
+	lines[lines.size() - 20] = "missing 'late'";
+	lines[lines.size() / 2] = "	missing 'early'";
+
+	const FileTaxonomy actual = scan_file_parallel(lines, concurrent, 4);
+
+	EXPECT_EQ(actual, scan_file(lines, machine));
+	ASSERT_EQ(actual.errors.size(), 1);
+	EXPECT_EQ(actual.errors[0].line_num, lines.size() / 2 + 1);
+}
+
+
+TEST(TaxScan, BranchStrategiesAreInterned) {
+	const TaxStrat first = branch_strat({"else", "elif"});
+	const TaxStrat second = branch_strat({"else", "elif"});
+	const TaxStrat other = branch_strat({"else"});
+
+	EXPECT_EQ(first.branch_instr.data(), second.branch_instr.data());
+	EXPECT_NE(first.branch_instr.data(), other.branch_instr.data());
+	ASSERT_EQ(first.branch_instr.size(), 2);
+	EXPECT_EQ(first.branch_instr[1], "elif");
+}
+
+
+TEST(TaxScan, FrozenMachineScansLikeStateMachine) {
+	const FrozenStateMachine frozen = FrozenStateMachine(std::make_shared<const InstructionTable>(std::vector<CommandInstr>{
+		{ .id = INSTR_ID_PRINT, .name = "print", .path = "/bin/print" },
+		{ .id = INSTR_ID_CURL, .name = "curl", .path = "/bin/curl" }
+	}));
+	FrozenStateMachine dynamic = frozen;
+	const std::vector<std::string> lines = {
+		"print 'A' --verbose",
+		"curl example.com",
+		"	--header 'B'",
+		"	--data 'C'",
+		"print `D`"
+	};
+
+	const FileTaxonomy expected = scan_file(lines, static_cast<StateMachine&>(dynamic));
+	const FileTaxonomy actual = scan_file(lines, frozen);
+
+	ASSERT_TRUE(expected.errors.empty());
+	EXPECT_EQ(actual, expected);
+	EXPECT_EQ(actual.statement_lines, expected.statement_lines);
+	EXPECT_EQ(scan_file({ "print 'A'", "missing" }, frozen), scan_file({ "print 'A'", "missing" }, static_cast<StateMachine&>(dynamic)));
+}
+
+
+TEST(TaxScan, ScriptDataIsNotInterned) {
+	TestStateMachine machine;
+	scan_file({
+		"hexdump",
+		"\tdata_word_first_line 00",
+		"\tdata_word_next_line 01",
+		"unknown_instruction_word"
+	}, machine);
+
+	EXPECT_EQ(Symbol::find("data_word_first_line"), std::nullopt);
+	EXPECT_EQ(Symbol::find("data_word_next_line"), std::nullopt);
+	EXPECT_EQ(Symbol::find("unknown_instruction_word"), std::nullopt);
+	EXPECT_TRUE(Symbol::find("hexdump").has_value());
+}
+
+
+// Statements of a routine by name and number of input lines, with their
+// branches in braces, so trees can be compared without spelling out lines.
+std::string outline(const RoutineTaxonomy& routine) {
+	std::string text;
+	for (const StatementTaxonomy& stmt : routine.statements) {
+		text += std::string(stmt.name.str()) + "/" + std::to_string(stmt.input.size());
+		for (const BranchTaxonomy& branch : stmt.branches) {
+			text += branch.default_branch ? " then{" : " else{";
+			text += outline(branch.routine) + "}";
+		}
+		text += ";";
+	}
+	return text;
+}
+
+
+// Random scripts of prints, if/else ladders and hexdump blocks, written
+// alongside the outline they should scan to.
+class ScriptGenerator {
+	private:
+	std::mt19937 rng;
+
+	size_t pick(size_t count) {
+		return std::uniform_int_distribution<size_t>(0, count - 1)(this->rng);
+	}
+
+	std::string nested(const std::string& indentation) {
+		const std::string units[] = { "  ", "    ", "\t" };
+		return indentation + units[this->pick(3)];
+	}
+
+	public:
+	std::vector<std::string> lines;
+	// Indexes of lines that start a statement or a branch.
+	std::vector<size_t> statement_lines;
+
+	ScriptGenerator(uint32_t seed) : rng(seed) {}
+
+	std::string routine(const std::string& indentation, size_t depth) {
+		std::string expected;
+		const size_t count = 1 + this->pick(3);
+		for (size_t idx = 0; idx < count; idx++) {
+			if (this->pick(4) == 0) {
+				this->lines.push_back("");
+			}
+			this->statement_lines.push_back(this->lines.size());
+			const size_t kind = depth == 0 ? 0 : this->pick(3);
+			if (kind == 0) {
+				this->lines.push_back(indentation + "print 'value " + std::to_string(this->lines.size()) + "'");
+				expected += "print/1;";
+			} else if (kind == 1) {
+				this->lines.push_back(indentation + "if cond");
+				expected += "if/1 then{" + this->routine(this->nested(indentation), depth - 1) + "}";
+				if (this->pick(2) == 0) {
+					this->statement_lines.push_back(this->lines.size());
+					this->lines.push_back(indentation + "else");
+					expected += " else{" + this->routine(this->nested(indentation), depth - 1) + "}";
+				}
+				if (this->pick(3) == 0) {
+					this->lines.push_back(indentation + "end");
+				}
+				expected += ";";
+			} else {
+				this->lines.push_back(indentation + "hexdump");
+				const std::string data = this->nested(indentation);
+				const size_t data_lines = 1 + this->pick(3);
+				for (size_t line = 0; line < data_lines; line++) {
+					this->lines.push_back(data + (this->pick(2) == 0 ? "else 00 01" : "print 02"));
+				}
+				expected += "hexdump/" + std::to_string(data_lines) + ";";
+			}
+		}
+		return expected;
+	}
+};
+
+
+TEST(TaxScan, RandomScriptsScanToTheirOutline) {
+	for (uint32_t seed = 0; seed < 2000; seed++) {
+		ScriptGenerator generator(seed);
+		const std::string expected = generator.routine("", 4);
+
+		const FileTaxonomy actual = scan_file(generator.lines, machine);
+
+		ASSERT_TRUE(actual.errors.empty()) << "seed " << seed;
+		ASSERT_EQ(outline(actual.routine), expected) << "seed " << seed;
+	}
+}
+
+
+TEST(TaxScan, RandomScriptsReportFirstError) {
+	for (uint32_t seed = 0; seed < 2000; seed++) {
+		ScriptGenerator generator(seed);
+		generator.routine("", 4);
+		std::vector<std::string> lines = generator.lines;
+		const std::vector<size_t>& statements = generator.statement_lines;
+		if (statements.size() < 2) {
+			continue;
+		}
+		std::mt19937 rng(seed);
+		const size_t first = std::uniform_int_distribution<size_t>(0, statements.size() - 2)(rng);
+		const size_t second = std::uniform_int_distribution<size_t>(first + 1, statements.size() - 1)(rng);
+		for (size_t statement : { statements[first], statements[second] }) {
+			const std::string& line = lines[statement];
+			lines[statement] = line.substr(0, line.find_first_not_of(" \t")) + "missing";
+		}
+
+		const FileTaxonomy actual = scan_file(lines, machine);
+
+		ASSERT_EQ(actual.errors.size(), 1) << "seed " << seed;
+		EXPECT_EQ(actual.errors[0].line_num, statements[first] + 1) << "seed " << seed;
+	}
+}
+
+
+TEST(TaxScan, ReportsFirstOfTwoErrors) {
+	const std::vector<std::string> lines = {
+		"if cond",
+		"	print 'A'",
+		"  print 'B'",
+		"print 'C'",
+		"missing"
+	};
+
+	const FileTaxonomy actual = scan_file(lines, machine);
+
+	ASSERT_EQ(actual.errors.size(), 1);
+	EXPECT_EQ(actual.errors[0].kind, ErrorKind::InvalidIndentation);
+	EXPECT_EQ(actual.errors[0].line_num, 3);
+}
+
+
+TEST(TaxScan, ScansFiftyLevelLadder) {
+	std::vector<std::string> lines;
+	std::string expected = "print/1;";
+	for (size_t level = 0; level < 50; level++) {
+		lines.push_back(std::string(level, '\t') + "if level");
+	}
+	lines.push_back(std::string(50, '\t') + "print 'deepest'");
+	for (size_t level = 0; level < 50; level++) {
+		expected = "if/1 then{" + expected + "};";
+	}
+
+	const FileTaxonomy actual = scan_file(lines, machine);
+
+	ASSERT_TRUE(actual.errors.empty());
+	EXPECT_EQ(outline(actual.routine), expected);
+}
+
+
+TEST(TaxScan, IndentationErrorPrintsNothing) {
+	testing::internal::CaptureStdout();
+	const FileTaxonomy actual = scan_file({ "if cond", "	print 'A'", "  print 'B'" }, machine);
+	const std::string printed = testing::internal::GetCapturedStdout();
+
+	ASSERT_EQ(actual.errors.size(), 1);
+	EXPECT_EQ(printed, "");
+}
@@ -0,0 +1,23 @@
+#include <filesystem>
+
+#include "test_util.h"
+
+namespace fs = std::filesystem;
+
+fs::path test_dir() {
+    return fs::temp_directory_path() / "lorikeet_test";
+}
+
+std::string temp_test_file(const std::string& name) {
+    const fs::path dir = test_dir();
+    fs::create_directories(dir);
+    const fs::path file = dir / name;
+    fs::remove(file);
+    return file;
+}
+
+std::string temp_test_dir(const std::string& name) {
+    const fs::path dir = test_dir() / name;
+    fs::remove_all(dir);
+    return dir;
+}
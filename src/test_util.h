@@ -0,0 +1,13 @@
+#ifndef LK_TEST_UTIL
+#define LK_TEST_UTIL
+
+#include <string>
+
+// Path of a scratch file under the shared test directory, which is created
+// if needed. A file left there by an earlier run is removed.
+std::string temp_test_file(const std::string& name);
+// Path of an empty scratch directory under the shared test directory. The
+// directory itself is not created.
+std::string temp_test_dir(const std::string& name);
+
+#endif
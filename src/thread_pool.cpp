@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t threads) :
+    task(nullptr),
+    task_count(0),
+    next_index(0),
+    active(0),
+    generation(0),
+    stopping(false) {
+    for (size_t slot = 1; slot < threads; slot++) {
+        this->workers.emplace_back([this, slot]() { this->work(slot); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return this->workers.size() + 1;
+}
+
+void ThreadPool::run(size_t count, const PoolTask& task) {
+    this->run(count, SlotTask([&task](size_t idx, size_t) { task(idx); }));
+}
+
+void ThreadPool::run(size_t count, const SlotTask& task) {
+    if (this->workers.empty() || count <= 1) {
+        for (size_t idx = 0; idx < count; idx++) {
+            task(idx, 0);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->task = &task;
+        this->task_count = count;
+        this->next_index = 0;
+        this->active = this->workers.size();
+        this->failure = nullptr;
+        this->generation++;
+    }
+    this->wake.notify_all();
+    this->drain(0);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done.wait(lock, [this]() { return this->active == 0; });
+    this->task = nullptr;
+    if (this->failure) {
+        std::rethrow_exception(this->failure);
+    }
+}
+
+void ThreadPool::work(size_t slot) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [&]() { return this->stopping || this->generation != seen_generation; });
+            if (this->stopping) {
+                return;
+            }
+            seen_generation = this->generation;
+        }
+        this->drain(slot);
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->active--;
+        if (this->active == 0) {
+            this->done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::drain(size_t slot) {
+    size_t idx;
+    while ((idx = this->next_index.fetch_add(1)) < this->task_count) {
+        try {
+            (*this->task)(idx, slot);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!this->failure) {
+                this->failure = std::current_exception();
+            }
+        }
+    }
+}
+
+size_t hardware_threads() {
+    const size_t threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
@@ -0,0 +1,51 @@
+#ifndef LK_THREAD_POOL
+#define LK_THREAD_POOL
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+typedef std::function<void(size_t index)> PoolTask;
+// Also gets the slot of the thread running it, in [0, size()), so tasks
+// can keep state per thread without locking.
+typedef std::function<void(size_t index, size_t slot)> SlotTask;
+
+// A fixed set of worker threads that run index based tasks. The thread that
+// calls run() works alongside the pool, so a pool of size 1 has no workers
+// and runs everything inline.
+class ThreadPool {
+    private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const SlotTask* task;
+    size_t task_count;
+    std::atomic<size_t> next_index;
+    size_t active;
+    uint64_t generation;
+    bool stopping;
+    std::exception_ptr failure;
+
+    void work(size_t slot);
+    void drain(size_t slot);
+
+    public:
+    ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    size_t size() const;
+    // Calls task(0) .. task(count - 1) and returns once all calls finished.
+    // The first exception thrown by a task is rethrown here. Not reentrant.
+    void run(size_t count, const PoolTask& task);
+    // Same as run, the calling thread always takes slot 0.
+    void run(size_t count, const SlotTask& task);
+};
+
+size_t hardware_threads();
+
+#endif
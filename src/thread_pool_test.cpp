@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+TEST(ThreadPool, RunsEveryIndexOnce) {
+    ThreadPool pool = ThreadPool(4);
+    std::vector<std::atomic<int>> calls(1000);
+
+    pool.run(calls.size(), [&](size_t idx) { calls[idx]++; });
+
+    for (size_t idx = 0; idx < calls.size(); idx++) {
+        EXPECT_EQ(calls[idx], 1);
+    }
+}
+
+TEST(ThreadPool, CanBeReused) {
+    ThreadPool pool = ThreadPool(3);
+    std::atomic<size_t> total = 0;
+
+    for (size_t round = 0; round < 50; round++) {
+        pool.run(20, [&](size_t idx) { total += idx; });
+    }
+
+    EXPECT_EQ(total, 50 * 190);
+}
+
+TEST(ThreadPool, SingleThreadRunsInline) {
+    ThreadPool pool = ThreadPool(1);
+    std::vector<size_t> order;
+
+    pool.run(5, [&](size_t idx) { order.push_back(idx); });
+
+    EXPECT_EQ(order, std::vector<size_t>({0, 1, 2, 3, 4}));
+}
+
+TEST(ThreadPool, RethrowsTaskFailure) {
+    ThreadPool pool = ThreadPool(2);
+
+    EXPECT_THROW(pool.run(10, [](size_t idx) {
+        if (idx == 7) {
+            throw std::runtime_error("failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(ThreadPool, SlotsAreExclusivePerThread) {
+    ThreadPool pool = ThreadPool(4);
+    std::vector<std::atomic<int>> running(pool.size());
+    std::atomic<bool> overlapped = false;
+    std::atomic<bool> out_of_range = false;
+
+    pool.run(1000, [&](size_t, size_t slot) {
+        if (slot >= running.size()) {
+            out_of_range = true;
+            return;
+        }
+        if (running[slot]++ != 0) {
+            overlapped = true;
+        }
+        running[slot]--;
+    });
+
+    EXPECT_FALSE(out_of_range);
+    EXPECT_FALSE(overlapped);
+}